@@ -0,0 +1,228 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "chip8_batch.h"
+#include "chip8_lanes.h"
+
+// Runs N machines in parallel, the roms given are assigned round-robin. Every
+// instance gets its own seed and its own scripted input, both derived from -seed,
+// so a run is reproducible whatever -threads is.
+//
+//     ./bin/batch [-n N] [-frames N] [-ipf N] [-threads N] [-seed N] [-jit] [-lanes] [-audio] [-csv] ROM...
+//
+// Prints a summary to stderr and, with -csv, one line per instance to stdout
+//     instance,rom,status,pc,frames,instructions,frame_hash[,audio_hash]
+
+#define DEFAULT_INSTANCES 1000
+#define DEFAULT_FRAMES 600
+// frames a scripted key stays in the same state
+#define INPUT_HOLD 8
+#define AUDIO_RATE 44100
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static uint64_t mix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30))*0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27))*0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// Every INPUT_HOLD frames an instance either releases everything or holds one key
+static uint16_t scripted_input(size_t instance, uint32_t frame, void *user) {
+    uint64_t seed = *(uint64_t *) user;
+    uint64_t r = mix64(seed ^ mix64(instance) ^ (frame/INPUT_HOLD));
+    if (r & 1) return 0;
+    return chip8_key_masks[(r >> 1) & 0xF];
+}
+
+char *shift(int *argc, char ***argv) {
+    return (*argc)--, *(*argv)++;
+}
+
+void usage(const char *program_name) {
+    fprintf(stderr, "    usage: %s [OPTIONS] <ROM.ch8>...\n", program_name);
+    fprintf(stderr, "    OPTIONS:\n");
+    fprintf(stderr, "        -n <N>         instances to run (default %d)\n", DEFAULT_INSTANCES);
+    fprintf(stderr, "        -frames <N>    frames to run each instance for (default %d)\n", DEFAULT_FRAMES);
+    fprintf(stderr, "        -ipf <N>       instructions per frame (default %d, or `ipf` in the rom .conf)\n", CYCLES_PER_SEC);
+    fprintf(stderr, "        -threads <N>   worker threads (default one per cpu)\n");
+    fprintf(stderr, "        -seed <N>      base seed of the rngs and of the scripted input\n");
+    fprintf(stderr, "        -jit           use the x86-64 recompiler\n");
+    fprintf(stderr, "        -quirks <NAME> quirk profile of every instance (default chip8, or `quirks` in the rom .conf)\n");
+    fprintf(stderr, "        -lanes         run %d instances at a time in SIMD lockstep\n", CHIP8_LANES);
+    fprintf(stderr, "        -audio         render the sound of every instance at %dHz and hash it\n", AUDIO_RATE);
+    fprintf(stderr, "        -csv           print the result of every instance\n");
+}
+
+int main(int argc, char **argv) {
+    char *program_name = shift(&argc, &argv);
+    long count = DEFAULT_INSTANCES;
+    long frames = DEFAULT_FRAMES;
+    int ipf = 0;
+    Chip8_Quirks quirks = __CHIP8_QUIRKS_CNT__;
+    int threads = 0;
+    uint64_t seed = 0;
+    bool use_jit = false;
+    bool lockstep = false;
+    bool audio = false;
+    bool csv = false;
+    char **roms = NULL;
+    int rom_cnt = 0;
+
+    while (argc > 0) {
+        char *arg = shift(&argc, &argv);
+        if (strcmp(arg, "-jit") == 0) {
+            use_jit = true;
+        } else if (strcmp(arg, "-lanes") == 0) {
+            lockstep = true;
+        } else if (strcmp(arg, "-audio") == 0) {
+            audio = true;
+        } else if (strcmp(arg, "-csv") == 0) {
+            csv = true;
+        } else if (strcmp(arg, "-quirks") == 0) {
+            if (argc == 0) {
+                fprintf(stderr, "ERROR: %s expects a value\n", arg);
+                usage(program_name);
+                return 1;
+            }
+
+            char *value = shift(&argc, &argv);
+            quirks = chip8_quirks_find(value);
+            if (quirks == __CHIP8_QUIRKS_CNT__) {
+                fprintf(stderr, "ERROR: unknown quirk profile %s\n", value);
+                usage(program_name);
+                return 1;
+            }
+        } else if (strcmp(arg, "-n") == 0 || strcmp(arg, "-frames") == 0 ||
+                   strcmp(arg, "-ipf") == 0 || strcmp(arg, "-threads") == 0) {
+            if (argc == 0) {
+                fprintf(stderr, "ERROR: %s expects a value\n", arg);
+                usage(program_name);
+                return 1;
+            }
+
+            char *value = shift(&argc, &argv);
+            // -ipf and -threads take 0 for the default
+            long min = strcmp(arg, "-n") == 0 || strcmp(arg, "-frames") == 0 ? 1 : 0;
+            char *end;
+            long n = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || n < min || n > INT_MAX) {
+                fprintf(stderr, "ERROR: %s expects a number from %ld to %d, got %s\n", arg, min, INT_MAX, value);
+                return 1;
+            }
+
+            if (strcmp(arg, "-n") == 0) count = n;
+            else if (strcmp(arg, "-frames") == 0) frames = n;
+            else if (strcmp(arg, "-ipf") == 0) ipf = n;
+            else threads = n;
+        } else if (strcmp(arg, "-seed") == 0) {
+            if (argc == 0) {
+                fprintf(stderr, "ERROR: %s expects a value\n", arg);
+                usage(program_name);
+                return 1;
+            }
+
+            seed = strtoull(shift(&argc, &argv), NULL, 0);
+        } else {
+            // the roms are the rest of the arguments
+            roms = argv - 1;
+            rom_cnt = argc + 1;
+            break;
+        }
+    }
+
+    if (rom_cnt == 0 || count <= 0 || frames <= 0 || ipf < 0) {
+        usage(program_name);
+        return 1;
+    }
+
+    Chip8_Batch batch;
+    if (!chip8_batch_init(&batch, count)) {
+        fprintf(stderr, "ERROR: could not allocate %ld machines\n", count);
+        return 1;
+    }
+
+    for (size_t i = 0; i < batch.count; i++) {
+        Chip8 *chip8 = &batch.machines[i];
+        const char *rom = roms[i % rom_cnt];
+        Chip8_Status status = chip8_load_rom(chip8, rom);
+        if (status == CHIP8_OK) status = chip8_load_config(chip8, rom);
+        if (status != CHIP8_OK) {
+            fprintf(stderr, "ERROR: could not load %s: %s\n", rom, chip8_status_name(status));
+            chip8_batch_free(&batch);
+            return 1;
+        }
+
+        if (ipf > 0) {
+            chip8->ipf = ipf;
+            chip8->cycles = ipf;
+        }
+        if (quirks != __CHIP8_QUIRKS_CNT__) chip8_set_quirks(chip8, quirks);
+
+        chip8_seed(chip8, mix64(seed + i));
+        if (use_jit && !chip8_jit_enable(chip8)) {
+            fprintf(stderr, "ERROR: the JIT is not supported on this host\n");
+            chip8_batch_free(&batch);
+            return 1;
+        }
+    }
+
+    batch.lockstep = lockstep;
+    batch.audio_rate = audio ? AUDIO_RATE : 0;
+    double start = now_ns();
+    chip8_batch_run(&batch, threads, frames, scripted_input, &seed);
+    double secs = (now_ns() - start)*1e-9;
+
+    uint64_t instructions = 0, idle = 0;
+    size_t faulted = 0;
+    for (size_t i = 0; i < batch.count; i++) {
+        Chip8_Result *r = &batch.results[i];
+        instructions += r->instructions;
+        idle += batch.machines[i].idle_skipped;
+        if (r->status != CHIP8_OK) faulted++;
+        if (csv) {
+            printf("%zu,\"%s\",%s,%04x,%u,%llu,%016llx", i, roms[i % rom_cnt],
+                   chip8_status_name(r->status), r->pc, r->frames,
+                   (unsigned long long) r->instructions, (unsigned long long) r->frame_hash);
+            if (audio) printf(",%016llx", (unsigned long long) r->audio_hash);
+            printf("\n");
+        }
+    }
+
+    fprintf(stderr, "%zu instances, %zu faulted, %llu instructions in %.3fs (%.1f MIPS), %llu stolen\n",
+            batch.count, faulted, (unsigned long long) instructions, secs,
+            instructions/secs/1e6, (unsigned long long) batch.steals);
+    fprintf(stderr, "%llu instructions (%.1f%%) skipped in idle loops\n",
+            (unsigned long long) idle, instructions ? 100.0*idle/instructions : 0.0);
+    if (lockstep) {
+        fprintf(stderr, "%llu instructions in lockstep, %llu lane by lane\n",
+                (unsigned long long) batch.vector_ops, (unsigned long long) batch.scalar_ops);
+    }
+
+    chip8_batch_free(&batch);
+    return 0;
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
@@ -0,0 +1,546 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+#include <math.h>
+
+#include "chip8.h"
+#include "chip8_rewind.h"
+#include "chip8_audio.h"
+
+// Headless benchmark over a ROM corpus.
+//
+//     ./bin/bench [-cycles N] [-ipf N] [-json] [-jit] [DIR...]   (default: games tests)
+//
+// For every ROM it runs N instructions with scripted random input and reports the
+// instruction rate. The instructions skipped in idle loops are not in the rate, they
+// are counted in the `idle` records of their own (with no time). It then reports the cost of each Op_Type (instructions are
+// timed one by one and the cost of the clock itself is subtracted), and the
+// kernels measured on their own: op_decode, the DRW path, the frame blit, rewind
+// and audio.
+//
+// Output is one record per line, either CSV
+//     section,name,count,total_ns,ns_per_op,mips
+// or, with -json, a single JSON object with the same fields.
+
+#define DEFAULT_CYCLES 1000000
+#define DEFAULT_IPF 1000
+#define SEED 0xC8C8C8C8u
+#define MAX_ROMS 1024
+#define MAX_RECORDS (MAX_ROMS + __OP_CNT__ + 16)
+
+typedef struct {
+    const char *section;
+    char name[256];
+    uint64_t count;
+    double total_ns;
+} Record;
+
+static Record records[MAX_RECORDS];
+static size_t record_cnt = 0;
+
+static void add_record(const char *section, const char *name, uint64_t count, double total_ns) {
+    if (record_cnt >= MAX_RECORDS) return;
+    Record *r = &records[record_cnt++];
+    r->section = section;
+    snprintf(r->name, sizeof(r->name), "%s", name);
+    r->count = count;
+    r->total_ns = total_ns;
+}
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static uint32_t xorshift32(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static bool has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static int compare_strings(const void *a, const void *b) {
+    return strcmp(*(char * const *) a, *(char * const *) b);
+}
+
+// Input script shared by every run: every frame there is a 1 in 8 chance of
+// switching to a random key (or none), and a pending Fx0A gets a key press that
+// is released on the next frame
+static void script_input(Chip8 *chip8, uint32_t *rng) {
+    uint32_t r = xorshift32(rng);
+    if (chip8->waiting_for_key) {
+        if (chip8->keyboard == 0) {
+            chip8_set_keyboard(chip8, chip8_key_masks[r & 0xF]);
+        } else {
+            chip8_set_keyboard(chip8, 0);
+        }
+    } else if ((r & 7) == 0) {
+        chip8_set_keyboard(chip8, (r >> 3) & 1 ? chip8_key_masks[(r >> 4) & 0xF] : 0);
+    }
+}
+
+static bool boot(Chip8 *chip8, const char *path, bool use_jit) {
+    chip8_init(chip8);
+    if (chip8_load_rom(chip8, path) != CHIP8_OK) return false;
+    if (use_jit) chip8_jit_enable(chip8);
+    chip8_seed(chip8, SEED);
+    return true;
+}
+
+// Whole-run throughput over the cycles of the emulated timeline. Returns the instructions
+// executed; the ones skipped in idle loops (chip8_skip_idle) go to skipped, they are part
+// of the timeline but cost next to nothing and would make the rate meaningless
+static uint64_t bench_run(Chip8 *chip8, uint64_t cycles, int ipf, double *elapsed, uint64_t *skipped) {
+    uint32_t rng = SEED;
+    uint64_t done = 0;
+    uint64_t idle_before = chip8->idle_skipped;
+    // a ROM stuck in a key wait executes nothing, the frame cap gets us out of it
+    double start = now_ns();
+    for (uint64_t frame = 0; done < cycles && frame < cycles; frame++) {
+        script_input(chip8, &rng);
+
+        int budget = cycles - done < (uint64_t) ipf ? (int) (cycles - done) : ipf;
+        int before = chip8->cycles;
+        Chip8_Status status = chip8_run_cycles(chip8, budget);
+        done += before - chip8->cycles;
+        if (status != CHIP8_OK) break;
+
+        chip8_tick_frame(chip8);
+    }
+
+    *elapsed = now_ns() - start;
+    *skipped = chip8->idle_skipped - idle_before;
+    return done - *skipped;
+}
+
+static double clock_overhead_ns(void) {
+    const int n = 100000;
+    double start = now_ns();
+    for (int i = 0; i < n; i++) now_ns();
+    return (now_ns() - start)/n;
+}
+
+// Same run as bench_run, one instruction at a time with each one timed
+static void bench_ops(Chip8 *chip8, uint64_t cycles, int ipf, double overhead,
+                      uint64_t counts[__OP_CNT__ + 1], double totals[__OP_CNT__ + 1]) {
+    uint32_t rng = SEED;
+    uint64_t done = 0;
+    for (uint64_t frame = 0; done < cycles && frame < cycles; frame++) {
+        script_input(chip8, &rng);
+
+        for (int i = 0; i < ipf && done < cycles && !chip8->waiting_for_key && !chip8->waiting_for_vblank; i++, done++) {
+            Op_Type type = op_decode(chip8_op_at(chip8, chip8->pc));
+            double start = now_ns();
+            Chip8_Status status = chip8_step(chip8);
+            double elapsed = now_ns() - start - overhead;
+            if (status != CHIP8_OK) return;
+
+            counts[type]++;
+            totals[type] += elapsed > 0 ? elapsed : 0;
+        }
+
+        chip8_tick_frame(chip8);
+    }
+}
+
+static void bench_decode(char **paths, size_t path_cnt) {
+    static Op ops[MAX_ROMS*MEMORY_SIZE/2];
+    size_t n = 0;
+    for (size_t i = 0; i < path_cnt; i++) {
+        FILE *file = fopen(paths[i], "rb");
+        if (file == NULL) continue;
+
+        uint8_t bytes[MEMORY_SIZE];
+        size_t size = fread(bytes, 1, sizeof(bytes), file);
+        fclose(file);
+        for (size_t k = 0; k + 1 < size; k += 2) {
+            ops[n++] = bytes[k] << 8 | bytes[k + 1];
+        }
+    }
+
+    if (n == 0) return;
+
+    const int passes = 200;
+    volatile uint64_t sink = 0;
+    uint64_t acc = 0;
+    double start = now_ns();
+    for (int p = 0; p < passes; p++) {
+        for (size_t i = 0; i < n; i++) acc += op_decode(ops[i]);
+    }
+    double elapsed = now_ns() - start;
+    sink += acc;
+    (void) sink;
+
+    add_record("kernel", "op_decode", (uint64_t) n*passes, elapsed);
+}
+
+// Memory filled with DRW instructions over random registers, drawing font
+// sprites of every height
+static void bench_drw(void) {
+    static Chip8 chip8;
+    chip8_init(&chip8);
+
+    uint32_t rng = SEED;
+    uint16_t count = 0;
+    for (uint16_t addr = 0x200; addr + 1 < MEMORY_SIZE; addr += 2, count++) {
+        uint32_t r = xorshift32(&rng);
+        uint8_t x = r & 0xF, y = (r >> 4) & 0xF, n = 1 + (r >> 8) % 15;
+        chip8.memory[addr] = 0xD0 | x;
+        chip8.memory[addr + 1] = y << 4 | n;
+    }
+    chip8_invalidate_code(&chip8, 0x200, MEMORY_SIZE - 0x200);
+
+    const int rounds = 200;
+    double elapsed = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < 0x10; i++) chip8.regs[i] = xorshift32(&rng);
+        chip8.regi = (xorshift32(&rng) % 0x10)*5;
+        chip8.pc = 0x200;
+
+        double start = now_ns();
+        chip8_run_cycles(&chip8, count);
+        elapsed += now_ns() - start;
+    }
+
+    add_record("kernel", "op_drw", (uint64_t) count*rounds, elapsed);
+}
+
+// The same on a 128x64 screen with both planes selected, with 16x16 sprites (Dxy0)
+// among the others, so every DRW goes through screen_draw
+static void bench_drw_hires(void) {
+    static Chip8 chip8;
+    chip8_init(&chip8);
+    chip8.hires = true;
+    chip8.planes = 3;
+
+    uint32_t rng = SEED;
+    uint16_t count = 0;
+    for (uint16_t addr = 0x200; addr + 1 < MEMORY_SIZE; addr += 2, count++) {
+        uint32_t r = xorshift32(&rng);
+        uint8_t x = r & 0xF, y = (r >> 4) & 0xF, n = (r >> 8) % 16;
+        chip8.memory[addr] = 0xD0 | x;
+        chip8.memory[addr + 1] = y << 4 | n;
+    }
+    chip8_invalidate_code(&chip8, 0x200, MEMORY_SIZE - 0x200);
+
+    const int rounds = 200;
+    double elapsed = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < 0x10; i++) chip8.regs[i] = xorshift32(&rng);
+        chip8.regi = xorshift32(&rng) % 0x100;
+        chip8.pc = 0x200;
+
+        double start = now_ns();
+        chip8_run_cycles(&chip8, count);
+        elapsed += now_ns() - start;
+    }
+
+    add_record("kernel", "op_drw_hires", (uint64_t) count*rounds, elapsed);
+}
+
+// The SUPER-CHIP/XO-CHIP scrolls (00Cn, 00Dn, 00FB, 00FC) at random, on both planes
+// of a random 128x64 screen
+static void bench_scroll(void) {
+    static Chip8 chip8;
+    chip8_init(&chip8);
+    chip8.hires = true;
+    chip8.planes = 3;
+
+    uint32_t rng = SEED;
+    uint16_t count = 0;
+    for (uint16_t addr = 0x200; addr + 1 < MEMORY_SIZE; addr += 2, count++) {
+        static const uint8_t scrolls[] = { 0xC0, 0xD0, 0xFB, 0xFC };
+        uint32_t r = xorshift32(&rng);
+        uint8_t op = scrolls[r & 3];
+        chip8.memory[addr] = 0x00;
+        chip8.memory[addr + 1] = op < 0xF0 ? op | (1 + (r >> 2) % 15) : op;
+    }
+    chip8_invalidate_code(&chip8, 0x200, MEMORY_SIZE - 0x200);
+
+    const int rounds = 200;
+    double elapsed = 0;
+    for (int round = 0; round < rounds; round++) {
+        for (int p = 0; p < FRAME_PLANES; p++) {
+            for (int y = 0; y < HIRES_H; y++) {
+                chip8.frame_buffer[p].lo[y] = (uint64_t) xorshift32(&rng) << 32 | xorshift32(&rng);
+                chip8.frame_buffer[p].hi[y] = (uint64_t) xorshift32(&rng) << 32 | xorshift32(&rng);
+            }
+        }
+        chip8.pc = 0x200;
+
+        double start = now_ns();
+        chip8_run_cycles(&chip8, count);
+        elapsed += now_ns() - start;
+    }
+
+    add_record("kernel", "screen_scroll", (uint64_t) count*rounds, elapsed);
+}
+
+// What the frontend does to present a frame, minus the texture upload: expand the
+// frame buffer into RGBA pixels
+static void bench_blit(void) {
+    static Chip8 chip8;
+    static uint32_t pixels[FRAME_H*FRAME_W];
+    // read back so the compiler can't drop pixels nobody looks at
+    static volatile uint32_t sink;
+    chip8_init(&chip8);
+
+    uint32_t rng = SEED;
+    const int frames = 2000;
+    double elapsed = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        for (int y = 0; y < FRAME_H; y++) {
+            chip8.frame_buffer[0].lo[y] = (uint64_t) xorshift32(&rng) << 32 | xorshift32(&rng);
+        }
+
+        double start = now_ns();
+        chip8_frame_expand(&chip8, pixels, 0xFFFFFFFF, 0xFF000000);
+        elapsed += now_ns() - start;
+        sink += pixels[frame % (FRAME_H*FRAME_W)];
+    }
+
+    add_record("kernel", "frame_expand", frames, elapsed);
+}
+
+// A minute of snapshots of a rom under scripted input, then scrubbing all the
+// way back one frame at a time
+static void bench_rewind(const char *path) {
+    static Chip8 chip8;
+    if (!boot(&chip8, path, false)) return;
+
+    const int frames = 60*60;
+    Chip8_Rewind *rewind = chip8_rewind_create(4 << 20, frames, 60);
+    if (rewind == NULL) return;
+
+    uint32_t rng = SEED;
+    double push = 0;
+    for (int frame = 0; frame < frames; frame++) {
+        script_input(&chip8, &rng);
+        chip8_run_cycles(&chip8, chip8.cycles);
+        chip8_tick_frame(&chip8);
+
+        double start = now_ns();
+        chip8_rewind_push(rewind, &chip8);
+        push += now_ns() - start;
+    }
+
+    int held = chip8_rewind_count(rewind);
+    add_record("kernel", "rewind_push", frames, push);
+
+    double start = now_ns();
+    for (int i = 1; i < held; i++) chip8_rewind_restore(rewind, 1, &chip8);
+    add_record("kernel", "rewind_restore", held - 1, now_ns() - start);
+
+    chip8_rewind_destroy(rewind);
+}
+
+// A second of sound at 44.1kHz in callback sized chunks: the beep as the frontend
+// used to make it (sinf per sample), from the wavetable, and an XO-CHIP pattern
+static void bench_audio(void) {
+    static int16_t samples[512];
+    static volatile int16_t sink;
+    const int rate = 44100, chunks = rate/512;
+
+    float phase = 0;
+    double start = now_ns();
+    for (int c = 0; c < chunks; c++) {
+        for (int i = 0; i < 512; i++) {
+            samples[i] = (int16_t) (32000.0f*sinf(2*3.14159265f*phase));
+            phase += 440.0f/rate;
+            if (phase > 1.0f) phase -= 1.0f;
+        }
+        sink += samples[c];
+    }
+    add_record("kernel", "audio_sinf", chunks*512, now_ns() - start);
+
+    static Chip8 chip8;
+    chip8_init(&chip8);
+    chip8.sound_timer = 1;
+    for (int pattern = 0; pattern < 2; pattern++) {
+        Chip8_Audio audio;
+        chip8_audio_init(&audio, rate);
+        chip8.has_pattern = pattern;
+        memset(chip8.audio_pattern, 0xF0, sizeof(chip8.audio_pattern));
+        chip8_audio_update(&audio, &chip8);
+
+        start = now_ns();
+        for (int c = 0; c < chunks; c++) {
+            chip8_audio_render(&audio, samples, 512);
+            sink += samples[c];
+        }
+        add_record("kernel", pattern ? "audio_pattern" : "audio_beep", chunks*512, now_ns() - start);
+    }
+}
+
+static void print_csv(void) {
+    printf("section,name,count,total_ns,ns_per_op,mips\n");
+    for (size_t i = 0; i < record_cnt; i++) {
+        Record *r = &records[i];
+        double per = r->count ? r->total_ns/r->count : 0;
+        printf("%s,\"%s\",%llu,%.0f,%.3f,%.3f\n", r->section, r->name, (unsigned long long) r->count,
+               r->total_ns, per, per > 0 ? 1e3/per : 0);
+    }
+}
+
+static void print_json_string(const char *s) {
+    putchar('"');
+    for (; *s; s++) {
+        if (*s == '"' || *s == '\\') putchar('\\');
+        putchar(*s);
+    }
+    putchar('"');
+}
+
+static void print_json(uint64_t cycles, int ipf, bool use_jit) {
+    printf("{\n  \"cycles\": %llu,\n  \"ipf\": %d,\n  \"jit\": %s,\n  \"records\": [\n",
+           (unsigned long long) cycles, ipf, use_jit ? "true" : "false");
+    for (size_t i = 0; i < record_cnt; i++) {
+        Record *r = &records[i];
+        double per = r->count ? r->total_ns/r->count : 0;
+        printf("    {\"section\": \"%s\", \"name\": ", r->section);
+        print_json_string(r->name);
+        printf(", \"count\": %llu, \"total_ns\": %.0f, \"ns_per_op\": %.3f, \"mips\": %.3f}%s\n",
+               (unsigned long long) r->count, r->total_ns, per, per > 0 ? 1e3/per : 0,
+               i + 1 < record_cnt ? "," : "");
+    }
+    printf("  ]\n}\n");
+}
+
+char *shift(int *argc, char ***argv) {
+    return (*argc)--, *(*argv)++;
+}
+
+int main(int argc, char **argv) {
+    char *program_name = shift(&argc, &argv);
+    uint64_t cycles = DEFAULT_CYCLES;
+    int ipf = DEFAULT_IPF;
+    bool json = false, use_jit = false;
+    char *dirs[16];
+    size_t dir_cnt = 0;
+
+    while (argc > 0) {
+        char *arg = shift(&argc, &argv);
+        if (strcmp(arg, "-json") == 0) {
+            json = true;
+        } else if (strcmp(arg, "-jit") == 0) {
+            use_jit = true;
+        } else if ((strcmp(arg, "-cycles") == 0 || strcmp(arg, "-ipf") == 0) && argc > 0) {
+            bool is_cycles = strcmp(arg, "-cycles") == 0;
+            char *str = shift(&argc, &argv);
+            char *end;
+            errno = 0;
+            long long value = strtoll(str, &end, 10);
+            if (*str == '\0' || *end != '\0' || errno == ERANGE || value <= 0 || (!is_cycles && value > INT_MAX)) {
+                fprintf(stderr, "ERROR: %s must be a positive number, got %s\n", arg, str);
+                return 1;
+            }
+            if (is_cycles) cycles = value; else ipf = value;
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "ERROR: unknown option %s\n", arg);
+            fprintf(stderr, "    usage: %s [-cycles N] [-ipf N] [-json] [-jit] [DIR...]\n", program_name);
+            return 1;
+        } else if (dir_cnt < 16) {
+            dirs[dir_cnt++] = arg;
+        }
+    }
+
+    if (dir_cnt == 0) {
+        dirs[dir_cnt++] = "games";
+        dirs[dir_cnt++] = "tests";
+    }
+
+    static char *paths[MAX_ROMS];
+    size_t path_cnt = 0;
+    for (size_t i = 0; i < dir_cnt; i++) {
+        DIR *dir = opendir(dirs[i]);
+        if (dir == NULL) {
+            fprintf(stderr, "ERROR: could not open directory %s: %s\n", dirs[i], strerror(errno));
+            return 1;
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(dir)) != NULL && path_cnt < MAX_ROMS) {
+            if (!has_suffix(entry->d_name, ".ch8")) continue;
+            size_t len = strlen(dirs[i]) + strlen(entry->d_name) + 2;
+            paths[path_cnt] = malloc(len);
+            snprintf(paths[path_cnt++], len, "%s/%s", dirs[i], entry->d_name);
+        }
+
+        closedir(dir);
+    }
+
+    qsort(paths, path_cnt, sizeof(*paths), compare_strings);
+
+    static Chip8 chip8;
+    uint64_t total_instructions = 0, total_skipped = 0;
+    double total_ns = 0;
+    for (size_t i = 0; i < path_cnt; i++) {
+        if (!boot(&chip8, paths[i], use_jit)) continue;
+
+        double elapsed;
+        uint64_t skipped;
+        uint64_t done = bench_run(&chip8, cycles, ipf, &elapsed, &skipped);
+        chip8_jit_disable(&chip8);
+        add_record("rom", paths[i], done, elapsed);
+        if (skipped) add_record("idle", paths[i], skipped, 0);
+        total_instructions += done;
+        total_skipped += skipped;
+        total_ns += elapsed;
+    }
+    add_record("total", "all roms", total_instructions, total_ns);
+    add_record("idle", "all roms", total_skipped, 0);
+
+    static uint64_t counts[__OP_CNT__ + 1];
+    static double totals[__OP_CNT__ + 1];
+    double overhead = clock_overhead_ns();
+    for (size_t i = 0; i < path_cnt; i++) {
+        if (!boot(&chip8, paths[i], false)) continue;
+        bench_ops(&chip8, cycles/10, ipf, overhead, counts, totals);
+    }
+    for (Op_Type type = 0; type < __OP_CNT__; type++) {
+        if (counts[type]) add_record("op", op_names[type], counts[type], totals[type]);
+    }
+
+    bench_decode(paths, path_cnt);
+    bench_drw();
+    bench_drw_hires();
+    bench_scroll();
+    bench_blit();
+    if (path_cnt > 0) bench_rewind(paths[0]);
+    bench_audio();
+
+    if (json) {
+        print_json(cycles, ipf, use_jit);
+    } else {
+        print_csv();
+    }
+
+    for (size_t i = 0; i < path_cnt; i++) free(paths[i]);
+    return 0;
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
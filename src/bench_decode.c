@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include <dirent.h>
+
+#include "chip8.h"
+
+// Microbenchmark of the opcode decoder: op_decode (lookup table) against
+// op_decode_scan (linear walk over op_decode_table) on the words of every ROM
+// in a directory.
+//
+//     ./bin/bench_decode [DIR] [PASSES]
+
+#define DEFAULT_PASSES 2000
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static bool has_suffix(const char *s, const char *suffix) {
+    size_t n = strlen(s), m = strlen(suffix);
+    return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+static size_t read_rom_words(const char *path, Op *ops, size_t cap) {
+    uint8_t bytes[MEMORY_SIZE];
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    size_t size = fread(bytes, 1, sizeof(bytes), file);
+    fclose(file);
+
+    size_t n = 0;
+    for (size_t i = 0; i + 1 < size && n < cap; i += 2) {
+        ops[n++] = bytes[i] << 8 | bytes[i + 1];
+    }
+
+    return n;
+}
+
+typedef Op_Type (*Decoder)(Op op);
+
+// returns ns per decoded op; *sink keeps the compiler from dropping the loop
+static double time_decoder(Decoder decode, const Op *ops, size_t n, int passes, uint64_t *sink) {
+    uint64_t acc = 0;
+    double start = now_ns();
+    for (int p = 0; p < passes; p++) {
+        for (size_t i = 0; i < n; i++) {
+            acc += decode(ops[i]);
+        }
+    }
+
+    double elapsed = now_ns() - start;
+    *sink += acc;
+    return elapsed/((double) n*passes);
+}
+
+char *shift(int *argc, char ***argv) {
+    return (*argc)--, *(*argv)++;
+}
+
+int main(int argc, char **argv) {
+    shift(&argc, &argv);
+    const char *dir_path = argc > 0 ? shift(&argc, &argv) : "games";
+    int passes = argc > 0 ? atoi(shift(&argc, &argv)) : DEFAULT_PASSES;
+    if (passes <= 0) passes = DEFAULT_PASSES;
+
+    op_decode_init();
+
+    DIR *dir = opendir(dir_path);
+    if (dir == NULL) {
+        fprintf(stderr, "ERROR: could not open directory %s: %s\n", dir_path, strerror(errno));
+        return 1;
+    }
+
+    uint64_t sink = 0;
+    size_t total_ops = 0, roms = 0;
+    double total_scan = 0, total_lut = 0;
+
+    printf("%-60s %6s %10s %10s %8s\n", "rom", "ops", "scan ns/op", "lut ns/op", "speedup");
+
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (!has_suffix(entry->d_name, ".ch8")) continue;
+
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", dir_path, entry->d_name);
+
+        Op ops[MEMORY_SIZE/2];
+        size_t n = read_rom_words(path, ops, MEMORY_SIZE/2);
+        if (n == 0) continue;
+
+        for (size_t i = 0; i < n; i++) {
+            if (op_decode(ops[i]) != op_decode_scan(ops[i])) {
+                fprintf(stderr, "ERROR: decoders disagree on %04x in %s\n", ops[i], path);
+                return 1;
+            }
+        }
+
+        double scan = time_decoder(op_decode_scan, ops, n, passes, &sink);
+        double lut = time_decoder(op_decode, ops, n, passes, &sink);
+        printf("%-60.60s %6zu %10.2f %10.2f %7.1fx\n", entry->d_name, n, scan, lut, scan/lut);
+
+        total_scan += scan*n;
+        total_lut += lut*n;
+        total_ops += n;
+        roms++;
+    }
+
+    closedir(dir);
+
+    if (roms == 0) {
+        fprintf(stderr, "ERROR: no .ch8 files in %s\n", dir_path);
+        return 1;
+    }
+
+    printf("%-60s %6zu %10.2f %10.2f %7.1fx\n", "TOTAL", total_ops,
+           total_scan/total_ops, total_lut/total_ops, total_scan/total_lut);
+    fprintf(stderr, "(%zu roms, %d passes, sink %llu)\n", roms, passes, (unsigned long long) sink);
+
+    return 0;
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
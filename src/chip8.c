@@ -0,0 +1,932 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <ctype.h>
+
+#include "chip8.h"
+
+// dirty_rows with every row of the screen set
+#define ALL_ROWS(hires) ((hires) ? ~(uint64_t) 0 : ((uint64_t) 1 << FRAME_H) - 1)
+
+const Op_Pattern op_decode_table[__OP_CNT__] = {
+    [OP_CLS]         = { 0xFFFF, 0x00E0 },
+    [OP_RET]         = { 0xFFFF, 0x00EE },
+    [OP_SCD]         = { 0xFFF0, 0x00C0 },
+    [OP_SCU]         = { 0xFFF0, 0x00D0 },
+    [OP_SCR]         = { 0xFFFF, 0x00FB },
+    [OP_SCL]         = { 0xFFFF, 0x00FC },
+    [OP_LOW]         = { 0xFFFF, 0x00FE },
+    [OP_HIGH]        = { 0xFFFF, 0x00FF },
+    [OP_SYS]         = { 0xF000, 0x0000 },
+    [OP_CALL]        = { 0xF000, 0x2000 },
+    [OP_SE_RB]       = { 0xF000, 0x3000 },
+    [OP_SE_RR]       = { 0xF000, 0x5000 },
+    [OP_OR]          = { 0xF00F, 0x8001 },
+    [OP_AND]         = { 0xF00F, 0x8002 },
+    [OP_XOR]         = { 0xF00F, 0x8003 },
+    [OP_SUB]         = { 0xF00F, 0x8005 },
+    [OP_SHR]         = { 0xF00F, 0x8006 },
+    [OP_SUBN]        = { 0xF00F, 0x8007 },
+    [OP_SHL]         = { 0xF00F, 0x800E },
+    [OP_SNE_R_B]     = { 0xF000, 0x4000 },
+    [OP_SNE_R_R]     = { 0xF00F, 0x9000 },
+    [OP_JP_ADDR]     = { 0xF000, 0x1000 },
+    [OP_JP_V0_ADDR]  = { 0xF000, 0xB000 },
+    [OP_RND]         = { 0xF000, 0xC000 },
+    [OP_DRW]         = { 0xF000, 0xD000 },
+    [OP_SKP]         = { 0xF0FF, 0xE09E },
+    [OP_SKNP]        = { 0xF0FF, 0xE0A1 },
+    [OP_ADD_R_B]     = { 0xF000, 0x7000 },
+    [OP_ADD_R_R]     = { 0xF00F, 0x8004 },
+    [OP_ADD_I_R]     = { 0xF0FF, 0xF01E },
+    [OP_LD_R_B]      = { 0xF000, 0x6000 },
+    [OP_LD_R_R]      = { 0xF00F, 0x8000 },
+    [OP_LD_I_ADDR]   = { 0xF000, 0xA000 },
+    [OP_LD_R_DT]     = { 0xF0FF, 0xF007 },
+    [OP_LD_R_K]      = { 0xF0FF, 0xF00A },
+    [OP_LD_DT_R]     = { 0xF0FF, 0xF015 },
+    [OP_LD_ST_R]     = { 0xF0FF, 0xF018 },
+    [OP_LD_FONT_R]   = { 0xF0FF, 0xF029 },
+    [OP_LD_BCD_R]    = { 0xF0FF, 0xF033 },
+    [OP_LD_IMEM_R]   = { 0xF0FF, 0xF055 },
+    [OP_LD_R_IMEM]   = { 0xF0FF, 0xF065 },
+    [OP_LD_HF_R]     = { 0xF0FF, 0xF030 },
+    [OP_PLANE]       = { 0xF0FF, 0xF001 },
+    [OP_AUDIO]       = { 0xFFFF, 0xF002 },
+    [OP_PITCH]       = { 0xF0FF, 0xF03A }
+};
+
+const char *op_names[__OP_CNT__] = {
+    [OP_CLS]         = "OP_CLS",
+    [OP_RET]         = "OP_RET",
+    [OP_SCD]         = "OP_SCD",
+    [OP_SCU]         = "OP_SCU",
+    [OP_SCR]         = "OP_SCR",
+    [OP_SCL]         = "OP_SCL",
+    [OP_LOW]         = "OP_LOW",
+    [OP_HIGH]        = "OP_HIGH",
+    [OP_SYS]         = "OP_SYS",
+    [OP_CALL]        = "OP_CALL",
+    [OP_SE_RB]       = "OP_SE_RB",
+    [OP_SE_RR]       = "OP_SE_RR",
+    [OP_OR]          = "OP_OR",
+    [OP_AND]         = "OP_AND",
+    [OP_XOR]         = "OP_XOR",
+    [OP_SUB]         = "OP_SUB",
+    [OP_SHR]         = "OP_SHR",
+    [OP_SUBN]        = "OP_SUBN",
+    [OP_SHL]         = "OP_SHL",
+    [OP_SNE_R_B]     = "OP_SNE_R_B",
+    [OP_SNE_R_R]     = "OP_SNE_R_R",
+    [OP_JP_ADDR]     = "OP_JP_ADDR",
+    [OP_JP_V0_ADDR]  = "OP_JP_V0_ADDR",
+    [OP_RND]         = "OP_RND",
+    [OP_DRW]         = "OP_DRW",
+    [OP_SKP]         = "OP_SKP",
+    [OP_SKNP]        = "OP_SKNP",
+    [OP_ADD_R_B]     = "OP_ADD_R_B",
+    [OP_ADD_R_R]     = "OP_ADD_R_R",
+    [OP_ADD_I_R]     = "OP_ADD_I_R",
+    [OP_LD_R_B]      = "OP_LD_R_B",
+    [OP_LD_R_R]      = "OP_LD_R_R",
+    [OP_LD_I_ADDR]   = "OP_LD_I_ADDR",
+    [OP_LD_R_DT]     = "OP_LD_R_DT",
+    [OP_LD_R_K]      = "OP_LD_R_K",
+    [OP_LD_DT_R]     = "OP_LD_DT_R",
+    [OP_LD_ST_R]     = "OP_LD_ST_R",
+    [OP_LD_FONT_R]   = "OP_LD_FONT_R",
+    [OP_LD_BCD_R]    = "OP_LD_BCD_R",
+    [OP_LD_IMEM_R]   = "OP_LD_IMEM_R",
+    [OP_LD_R_IMEM]   = "OP_LD_R_IMEM",
+    [OP_LD_HF_R]     = "OP_LD_HF_R",
+    [OP_PLANE]       = "OP_PLANE",
+    [OP_AUDIO]       = "OP_AUDIO",
+    [OP_PITCH]       = "OP_PITCH"
+};
+
+const Chip8_Quirk_Set chip8_quirk_sets[__CHIP8_QUIRKS_CNT__] = {
+    [CHIP8_QUIRKS_CHIP8] = {
+        .name = "chip8", .vf_reset = true, .shift_vx = false, .load_store = CHIP8_I_PLUS_X_PLUS_1,
+        .jump_vx = false, .wrap = false, .display_wait = CHIP8_WAIT_NEVER,
+        .row_hits = false,
+    },
+    [CHIP8_QUIRKS_VIP] = {
+        .name = "vip", .vf_reset = true, .shift_vx = false, .load_store = CHIP8_I_PLUS_X_PLUS_1,
+        .jump_vx = false, .wrap = false, .display_wait = CHIP8_WAIT_ALWAYS,
+        .row_hits = false,
+    },
+    [CHIP8_QUIRKS_CHIP48] = {
+        .name = "chip48", .vf_reset = false, .shift_vx = true, .load_store = CHIP8_I_PLUS_X,
+        .jump_vx = true, .wrap = false, .display_wait = CHIP8_WAIT_NEVER,
+        .row_hits = false,
+    },
+    [CHIP8_QUIRKS_SCHIP] = {
+        .name = "schip", .vf_reset = false, .shift_vx = true, .load_store = CHIP8_I_KEPT,
+        .jump_vx = true, .wrap = false, .display_wait = CHIP8_WAIT_LORES,
+        .row_hits = true,
+    },
+    [CHIP8_QUIRKS_XOCHIP] = {
+        .name = "xochip", .vf_reset = false, .shift_vx = false, .load_store = CHIP8_I_PLUS_X_PLUS_1,
+        .jump_vx = false, .wrap = true, .display_wait = CHIP8_WAIT_NEVER,
+        .row_hits = false,
+    },
+};
+
+const uint16_t chip8_key_masks[0x10] = {
+    [0x1] = CHIP8_KEY_1,
+    [0x2] = CHIP8_KEY_2,
+    [0x3] = CHIP8_KEY_3,
+    [0xC] = CHIP8_KEY_C,
+    [0x4] = CHIP8_KEY_4,
+    [0x5] = CHIP8_KEY_5,
+    [0x6] = CHIP8_KEY_6,
+    [0xD] = CHIP8_KEY_D,
+    [0x7] = CHIP8_KEY_7,
+    [0x8] = CHIP8_KEY_8,
+    [0x9] = CHIP8_KEY_9,
+    [0xE] = CHIP8_KEY_E,
+    [0xA] = CHIP8_KEY_A,
+    [0x0] = CHIP8_KEY_0,
+    [0xB] = CHIP8_KEY_B,
+    [0xF] = CHIP8_KEY_F,
+};
+
+// A sprite byte has its leftmost pixel in bit 7, a frame buffer row has column x in
+// bit x. DRW reverses each byte once through this table and shifts it into place
+#define R2(n) n, n + 2*64, n + 1*64, n + 3*64
+#define R4(n) R2(n), R2(n + 2*16), R2(n + 1*16), R2(n + 3*16)
+#define R6(n) R4(n), R4(n + 2*4), R4(n + 1*4), R4(n + 3*4)
+static const uint8_t sprite_reverse[0x100] = { R6(0), R6(2), R6(1), R6(3) };
+#undef R2
+#undef R4
+#undef R6
+
+static const char *status_names[__CHIP8_STATUS_CNT__] = {
+    [CHIP8_OK]                  = "ok",
+    [CHIP8_ERR_ROM_OPEN]        = "could not open rom",
+    [CHIP8_ERR_ROM_READ]        = "could not read rom",
+    [CHIP8_ERR_ROM_TOO_BIG]     = "rom is too big",
+    [CHIP8_ERR_STACK_OVERFLOW]  = "stack overflow",
+    [CHIP8_ERR_STACK_UNDERFLOW] = "stack underflow",
+    [CHIP8_ERR_OUT_OF_BOUNDS]   = "out of bounds access",
+    [CHIP8_ERR_INVALID_KEY]     = "invalid key",
+    [CHIP8_ERR_NOT_IMPLEMENTED] = "op not implemented",
+    [CHIP8_ERR_CONFIG]          = "invalid rom config",
+    [CHIP8_ERR_INPUT_OPEN]      = "could not open input log",
+    [CHIP8_ERR_INPUT_FORMAT]    = "invalid input log",
+    [CHIP8_ERR_TRACE_OPEN]      = "could not write trace",
+    [CHIP8_ERR_WAV_OPEN]        = "could not write wav",
+};
+
+const char *chip8_status_name(Chip8_Status status) {
+    if (status >= __CHIP8_STATUS_CNT__) return "unknown";
+    return status_names[status];
+}
+static void load_fonts(Chip8 *chip8) {
+    uint16_t start = 0x000;
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11110000; // ****
+
+    chip8->memory[start++] = 0b00100000; //   *
+    chip8->memory[start++] = 0b01100000; //  **
+    chip8->memory[start++] = 0b00100000; //   *
+    chip8->memory[start++] = 0b00100000; //   *
+    chip8->memory[start++] = 0b01110000; //  ***
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b00010000; //    *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b11110000; // ****
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b00010000; //    *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b00010000; //    *
+    chip8->memory[start++] = 0b11110000; // ****
+
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b00010000; //    *
+    chip8->memory[start++] = 0b00010000; //    *
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b00010000; //    *
+    chip8->memory[start++] = 0b11110000; // ****
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11110000; // ****
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b00010000; //    *
+    chip8->memory[start++] = 0b00100000; //   *
+    chip8->memory[start++] = 0b01000000; //  *
+    chip8->memory[start++] = 0b01000000; //  *
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11110000; // ****
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b00010000; //    *
+    chip8->memory[start++] = 0b11110000; // ****
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b10010000; // *  *
+
+    chip8->memory[start++] = 0b11100000; // ***
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11100000; // ***
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11100000; // ***
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b11110000; // ****
+
+    chip8->memory[start++] = 0b11100000; // ***
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b10010000; // *  *
+    chip8->memory[start++] = 0b11100000; // ***
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b11110000; // ****
+
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b11110000; // ****
+    chip8->memory[start++] = 0b10000000; // *
+    chip8->memory[start++] = 0b10000000; // *
+
+    // SUPER-CHIP 8x10 digits for Fx30, with the letters XO-CHIP added
+    static const uint8_t big_font[0x10*10] = {
+        0xFF, 0xFF, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, // 0
+        0x18, 0x78, 0x78, 0x18, 0x18, 0x18, 0x18, 0x18, 0xFF, 0xFF, // 1
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // 2
+        0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 3
+        0xC3, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0x03, 0x03, // 4
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 5
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 6
+        0xFF, 0xFF, 0x03, 0x03, 0x06, 0x0C, 0x18, 0x18, 0x18, 0x18, // 7
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, // 8
+        0xFF, 0xFF, 0xC3, 0xC3, 0xFF, 0xFF, 0x03, 0x03, 0xFF, 0xFF, // 9
+        0x7E, 0xFF, 0xC3, 0xC3, 0xC3, 0xFF, 0xFF, 0xC3, 0xC3, 0xC3, // A
+        0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, 0xC3, 0xC3, 0xFC, 0xFC, // B
+        0x3C, 0xFF, 0xC3, 0xC0, 0xC0, 0xC0, 0xC0, 0xC3, 0xFF, 0x3C, // C
+        0xFC, 0xFE, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xC3, 0xFE, 0xFC, // D
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, // E
+        0xFF, 0xFF, 0xC0, 0xC0, 0xFF, 0xFF, 0xC0, 0xC0, 0xC0, 0xC0, // F
+    };
+    memcpy(&chip8->memory[BIG_FONT_ADDR], big_font, sizeof(big_font));
+}
+
+void chip8_seed(Chip8 *chip8, uint64_t seed) {
+    // splitmix64 so that close seeds give unrelated streams, and never a zero state
+    uint64_t z = seed + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27))*0x94D049BB133111EBull;
+    z ^= z >> 31;
+    chip8->rng = (uint32_t) z ? (uint32_t) z : 1;
+}
+
+static inline uint8_t chip8_random(Chip8 *chip8) {
+    uint32_t x = chip8->rng;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    chip8->rng = x;
+    return x >> 24;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t size) {
+    const uint8_t *bytes = data;
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+uint64_t chip8_frame_hash(const Chip8 *chip8) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    const Chip8_Plane *planes = chip8->frame_buffer;
+    if (chip8->hires) return fnv1a(hash, planes, sizeof(chip8->frame_buffer));
+
+    hash = fnv1a(hash, planes[0].lo, FRAME_H*sizeof(*planes[0].lo));
+    for (int y = 0; y < FRAME_H; y++) {
+        if (planes[1].lo[y]) return fnv1a(hash, planes[1].lo, FRAME_H*sizeof(*planes[1].lo));
+    }
+
+    return hash;
+}
+
+void chip8_frame_expand(const Chip8 *chip8, uint32_t *pixels, uint32_t on, uint32_t off) {
+    chip8_frame_expand_rows(chip8, pixels, ~(uint64_t) 0, on, off);
+}
+
+void chip8_frame_expand_rows(const Chip8 *chip8, uint32_t *pixels, uint64_t rows, uint32_t on, uint32_t off) {
+    const uint32_t colors[4] = { off, on, on, on };
+    chip8_planes_expand_rows(chip8->frame_buffer, chip8->hires, pixels, rows, colors);
+}
+
+void chip8_planes_expand_rows(const Chip8_Plane *planes, bool hires, uint32_t *pixels, uint64_t rows, const uint32_t colors[4]) {
+    int w = SCREEN_W(hires), h = SCREEN_H(hires);
+    uint32_t off = colors[0], diff = colors[0] ^ colors[1];
+    for (int y = 0; y < h; y++) {
+        if (!((rows >> y) & 1)) continue;
+
+        for (int half = 0; half < w/64; half++) {
+            uint64_t row = half ? planes[0].hi[y] : planes[0].lo[y];
+            uint64_t row2 = half ? planes[1].hi[y] : planes[1].lo[y];
+            uint32_t *out = &pixels[y*w + half*64];
+            if (row2 == 0) {
+                for (int x = 0; x < 64; x++) {
+                    // all ones when the pixel is lit, so no branch per pixel
+                    uint32_t lit = -(uint32_t) ((row >> x) & 1);
+                    out[x] = off ^ (diff & lit);
+                }
+            } else {
+                for (int x = 0; x < 64; x++) {
+                    out[x] = colors[((row >> x) & 1) | ((row2 >> x) & 1) << 1];
+                }
+            }
+        }
+    }
+}
+
+uint64_t chip8_take_dirty_rows(Chip8 *chip8) {
+    uint64_t rows = chip8->dirty_rows;
+    chip8->dirty_rows = 0;
+    return rows;
+}
+
+_Static_assert(offsetof(Chip8, stack) <= 64, "the hot fields of Chip8 must fit in one cache line");
+
+void chip8_init(Chip8 *chip8) {
+    memset(chip8, 0, sizeof(*chip8));
+    chip8->pc = 0x200;
+    chip8->ipf = CYCLES_PER_SEC;
+    chip8->cycles = chip8->ipf;
+    chip8->pitch = 64;
+    chip8->planes = 1;
+    // whatever was on screen before has to be replaced by the blank frame
+    chip8->dirty_rows = ALL_ROWS(false);
+    chip8_seed(chip8, 0);
+    load_fonts(chip8);
+    op_decode_init();
+}
+
+Chip8_Status chip8_load_rom_memory(Chip8 *chip8, const uint8_t *rom, size_t size) {
+    if (size >= MEMORY_SIZE - 0x200) return CHIP8_ERR_ROM_TOO_BIG;
+
+    memcpy(chip8->memory + 0x200, rom, size);
+    chip8_invalidate_code(chip8, 0x200, MEMORY_SIZE - 0x200);
+    return CHIP8_OK;
+}
+
+Chip8_Status chip8_load_rom(Chip8 *chip8, const char *rom) {
+    Chip8_Status status = CHIP8_OK;
+    FILE *file = fopen(rom, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", rom, strerror(errno));
+        status = CHIP8_ERR_ROM_OPEN;
+        goto ERROR;
+    }
+
+    long size;
+    if (fseek(file, 0, SEEK_END) < 0 || (size = ftell(file)) < 0) {
+        fprintf(stderr, "ERROR: something went wrong in the reading of %s: %s\n", rom, strerror(errno));
+        status = CHIP8_ERR_ROM_READ;
+        goto ERROR;
+    }
+
+    if (size >= MEMORY_SIZE - 0x200) {
+        fprintf(stderr, "ERROR: rom %s is too big. The specified size is %d and the program must start at 0x200\n", rom, MEMORY_SIZE);
+        status = CHIP8_ERR_ROM_TOO_BIG;
+        goto ERROR;
+    }
+
+    chip8_invalidate_code(chip8, 0x200, MEMORY_SIZE - 0x200);
+    rewind(file);
+    if ((long) fread(chip8->memory + 0x200, sizeof(*chip8->memory), size, file) != size) {
+        fprintf(stderr, "ERROR: could not read entire file %s: %s\n", rom, strerror(errno));
+        status = CHIP8_ERR_ROM_READ;
+        goto ERROR;
+    }
+
+ERROR:
+    if (file) {
+        fclose(file);
+    }
+
+    return status;
+}
+
+void chip8_save_state(const Chip8 *chip8, Chip8_State *state) {
+    memcpy(state->bytes, chip8, CHIP8_STATE_SIZE);
+}
+
+void chip8_load_state(Chip8 *chip8, const Chip8_State *state) {
+    // the decoded instructions only go stale where the memory is different
+    const uint8_t *memory = state->bytes + offsetof(Chip8, memory);
+    for (int page = 0; page < MEMORY_SIZE; page += 64) {
+        if (memcmp(chip8->memory + page, memory + page, 64) != 0) {
+            chip8_invalidate_code(chip8, page, 64);
+        }
+    }
+
+#if defined(PROFILE)
+    if (chip8->profile) chip8_profile_leave(chip8);
+#endif
+    Chip8_Quirks quirks = chip8->quirks;
+    memcpy(chip8, state->bytes, CHIP8_STATE_SIZE);
+    // the quirks come with the state, and the blocks of the JIT have the old ones baked in
+    if (chip8->quirks != quirks && chip8->jit) chip8_jit_invalidate(chip8->jit, 0, MEMORY_SIZE);
+#if defined(PROFILE)
+    if (chip8->profile) chip8_profile_arrive(chip8);
+#endif
+    chip8->dirty_rows = ALL_ROWS(chip8->hires);
+    chip8->should_draw = true;
+}
+
+static char *trim(char *s) {
+    while (isspace((unsigned char) *s)) s++;
+    char *end = s + strlen(s);
+    while (end > s && isspace((unsigned char) end[-1])) *--end = '\0';
+    return s;
+}
+
+Chip8_Status chip8_load_config(Chip8 *chip8, const char *rom) {
+    char path[1024];
+    const char *ext = strrchr(rom, '.');
+    int base_len = ext && !strchr(ext, '/') ? (int) (ext - rom) : (int) strlen(rom);
+    if (snprintf(path, sizeof(path), "%.*s.conf", base_len, rom) >= (int) sizeof(path)) {
+        return CHIP8_ERR_CONFIG;
+    }
+
+    FILE *file = fopen(path, "r");
+    if (file == NULL) return CHIP8_OK;
+
+    Chip8_Status status = CHIP8_OK;
+    char line[256];
+    for (int line_no = 1; fgets(line, sizeof(line), file); line_no++) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char *key = trim(line);
+        if (*key == '\0') continue;
+
+        char *eq = strchr(key, '=');
+        if (eq == NULL) {
+            fprintf(stderr, "ERROR: %s:%d: expected `key = value`\n", path, line_no);
+            status = CHIP8_ERR_CONFIG;
+            break;
+        }
+
+        *eq = '\0';
+        char *value = trim(eq + 1);
+        key = trim(key);
+
+        if (strcmp(key, "ipf") == 0) {
+            char *end;
+            long ipf = strtol(value, &end, 10);
+            if (*end != '\0' || ipf <= 0 || ipf > INT32_MAX) {
+                fprintf(stderr, "ERROR: %s:%d: invalid ipf `%s`\n", path, line_no, value);
+                status = CHIP8_ERR_CONFIG;
+                break;
+            }
+            chip8->ipf = ipf;
+            chip8->cycles = ipf;
+        } else if (strcmp(key, "quirks") == 0) {
+            Chip8_Quirks quirks = chip8_quirks_find(value);
+            if (quirks == __CHIP8_QUIRKS_CNT__) {
+                fprintf(stderr, "ERROR: %s:%d: unknown quirks `%s`\n", path, line_no, value);
+                status = CHIP8_ERR_CONFIG;
+                break;
+            }
+            chip8_set_quirks(chip8, quirks);
+        } else {
+            fprintf(stderr, "WARNING: %s:%d: unknown key `%s`\n", path, line_no, key);
+        }
+    }
+
+    fclose(file);
+    return status;
+}
+
+Chip8_Quirks chip8_quirks_find(const char *name) {
+    Chip8_Quirks quirks = 0;
+    while (quirks < __CHIP8_QUIRKS_CNT__ && strcmp(chip8_quirk_sets[quirks].name, name) != 0) quirks++;
+    return quirks;
+}
+
+void chip8_set_quirks(Chip8 *chip8, Chip8_Quirks quirks) {
+    if (chip8->quirks == quirks) return;
+
+    chip8->quirks = quirks;
+    // the blocks of the JIT have the quirks of the old profile baked in
+    if (chip8->jit) chip8_jit_invalidate(chip8->jit, 0, MEMORY_SIZE);
+}
+
+Op chip8_op_at(const Chip8 *chip8, uint16_t addr) {
+    return chip8->memory[addr & (MEMORY_SIZE - 1)] << 8 | chip8->memory[(addr + 1) & (MEMORY_SIZE - 1)];
+}
+
+// Reference decoder: walks op_decode_table in order and returns the first match.
+// Returns __OP_CNT__ for words that are not valid instructions
+Op_Type op_decode_scan(Op op) {
+    for (Op_Type type = 0; type < __OP_CNT__; type++) {
+        Op_Pattern op_pattern = op_decode_table[type];
+        if ((op_pattern.mask & op) == op_pattern.value) {
+            return type;
+        }
+    }
+
+    return __OP_CNT__;
+}
+
+// Every possible 16-bit word decoded ahead of time with op_decode_scan, so
+// the table can never disagree with op_decode_table
+static uint8_t op_decode_lut[0x10000];
+static bool op_decode_lut_ready = false;
+
+void op_decode_init(void) {
+    if (op_decode_lut_ready) return;
+    for (uint32_t op = 0; op < 0x10000; op++) {
+        op_decode_lut[op] = op_decode_scan(op);
+    }
+
+    op_decode_lut_ready = true;
+}
+
+Op_Type op_decode(Op op) {
+    return op_decode_lut[op];
+}
+
+bool is_pixel_active(const Chip8 *chip8, int x, int y) {
+    uint64_t lit = 0;
+    for (int p = 0; p < FRAME_PLANES; p++) {
+        const Chip8_Plane *plane = &chip8->frame_buffer[p];
+        lit |= (x < 64 ? plane->lo[y] : plane->hi[y]) >> (x & 63);
+    }
+
+    return lit & 1;
+}
+
+void chip8_tick_frame(Chip8 *chip8) {
+    chip8->cycles = chip8->ipf;
+    chip8->waiting_for_vblank = false;
+    chip8->idle = false;
+    chip8->should_draw = chip8->dirty_rows != 0;
+    if (chip8->delay_timer > 0) chip8->delay_timer--;
+    if (chip8->sound_timer > 0) {
+        chip8->sound_timer--;
+        if (chip8->sound_timer == 0) {
+            chip8->update_audio_state = true;
+        }
+    }
+}
+
+void chip8_set_keyboard(Chip8 *chip8, uint16_t keyboard) {
+    uint16_t released = chip8->keyboard & ~keyboard;
+    chip8->keyboard = keyboard;
+    if (chip8->waiting_for_key && released) {
+        for (uint8_t i = 0; i < 0x10; i++) {
+            if (released & chip8_key_masks[i]) {
+                chip8->waiting_for_key = false;
+                chip8->regs[chip8->key_reg] = i;
+                break;
+            }
+        }
+    }
+}
+
+void chip8_dump(const Chip8 *chip8) {
+    for (int i = 0; i < MEMORY_SIZE;) {
+        printf("0x%04x: ", i);
+        for (int k = 0; i < MEMORY_SIZE && k < 8; k++, i += 2) {
+            uint16_t x = chip8->memory[i] << 8 | chip8->memory[i + 1];
+            printf("%04x ", x);
+        }
+
+        printf("\n");
+    }
+}
+
+static void predecode(Chip8_Decoded *d, Op op) {
+    d->handler = op_decode(op) + 1;
+    d->x = (op & 0x0F00) >> 8;
+    d->y = (op & 0x00F0) >> 4;
+    d->n = op & 0x000F;
+    d->kk = op & 0x00FF;
+    d->nnn = op & 0x0FFF;
+}
+
+void chip8_invalidate_code(Chip8 *chip8, uint16_t addr, uint16_t len) {
+    if (len == 0) return;
+    uint32_t last = (uint32_t) addr + len - 1;
+    if (last >= MEMORY_SIZE) last = MEMORY_SIZE - 1;
+    // the instruction at an even address e covers the bytes e and e + 1
+#if defined(PROFILE)
+    // the profile settles what the instructions going away did, while they are still there
+    if (chip8->profile) chip8_profile_invalidate(chip8, addr & ~1, last);
+#endif
+    for (uint32_t i = addr >> 1; i <= (last >> 1); i++) {
+        chip8->decoded[i].handler = 0;
+    }
+
+    if (chip8->jit) chip8_jit_invalidate(chip8->jit, addr, len);
+}
+
+// The screen operations beyond the 64x32 single plane CHIP-8 one. The interpreter keeps
+// its own inline DRW and CLS for that case and calls these for everything else
+
+// 00E0 - CLS, on the selected planes
+static void screen_clear(Chip8 *chip8) {
+    for (int p = 0; p < FRAME_PLANES; p++) {
+        if (!((chip8->planes >> p) & 1)) continue;
+
+        Chip8_Plane *plane = &chip8->frame_buffer[p];
+        for (int y = 0; y < HIRES_H; y++) {
+            chip8->dirty_rows |= (uint64_t) ((plane->lo[y] | plane->hi[y]) != 0) << y;
+        }
+        memset(plane, 0, sizeof(*plane));
+    }
+}
+
+// 00FE - LOW, 00FF - HIGH: the screen is cleared on a change of resolution
+static void screen_resolution(Chip8 *chip8, bool hires) {
+    chip8->hires = hires;
+    memset(chip8->frame_buffer, 0, sizeof(chip8->frame_buffer));
+    chip8->dirty_rows = ALL_ROWS(hires);
+}
+
+// Dxyn in high resolution, Dxy0 (16x16 sprite) or on other planes than the first. Every
+// selected plane draws its own sprite, one after the other in memory. The sprite is
+// clipped at the edges, or wraps around with wrap. Returns whether a lit pixel was
+// turned off, or with row_hits (SUPER-CHIP 1.1 in 128x64) the number of rows that turned
+// one off or were clipped at the bottom; -1 when a sprite goes past the end of memory.
+// Row by row: a sprite is at most 16 rows from any row, and putting them through the
+// vectors of the scrolls came out slower (the op_drw_hires kernel of bin/bench)
+static int screen_draw(Chip8 *chip8, uint8_t vx, uint8_t vy, uint8_t n, bool wrap, bool row_hits) {
+    int w = SCREEN_W(chip8->hires), h = SCREEN_H(chip8->hires);
+    int x = vx % w;
+    int height = n ? n : 16, width = n ? 1 : 2;
+    uint16_t mem = chip8->regi;
+    uint64_t hit = 0;
+    // with row_hits, a bit for every row of the sprite that turned a lit pixel off
+    uint32_t hit_rows = 0;
+
+    for (int p = 0; p < FRAME_PLANES; p++) {
+        if (!((chip8->planes >> p) & 1)) continue;
+        if (mem + height*width > MEMORY_SIZE) return -1;
+
+        Chip8_Plane *plane = &chip8->frame_buffer[p];
+        const uint8_t *sprite = &chip8->memory[mem];
+        for (int i = 0, y = vy % h; i < height && (wrap || y < h); i++, y++) {
+            uint64_t bits = sprite_reverse[sprite[i*width]];
+            if (width == 2) bits |= (uint64_t) sprite_reverse[sprite[i*width + 1]] << 8;
+
+            // a 128-bit shift over the two halves of the row, the pixels past the
+            // right edge fall off the end of it
+            uint64_t lo = x < 64 ? bits << x : 0;
+            uint64_t hi = x < 64 ? (x > 0 ? bits >> (64 - x) : 0) : bits << (x - 64);
+            if (wrap) {
+                // and come back on the left
+                if (!chip8->hires) lo |= hi;
+                else if (x > HIRES_W - 16) lo |= bits >> (HIRES_W - x);
+            }
+            if (!chip8->hires) hi = 0;
+
+            int row = wrap ? y % h : y;
+            uint64_t row_hit = (plane->lo[row] & lo) | (plane->hi[row] & hi);
+            hit |= row_hit;
+            if (row_hits) hit_rows |= (uint32_t) (row_hit != 0) << i;
+            plane->lo[row] ^= lo;
+            plane->hi[row] ^= hi;
+            chip8->dirty_rows |= (uint64_t) ((lo | hi) != 0) << row;
+        }
+        mem += height*width;
+    }
+
+    if (row_hits && chip8->hires) {
+        int clipped = wrap || vy % h + height <= h ? 0 : vy % h + height - h;
+        return __builtin_popcount(hit_rows) + clipped;
+    }
+    return hit != 0;
+}
+
+// Four rows of a plane half per operation. GCC vector extensions, so a scroll is a few
+// AVX2 shifts with -mavx2 (or -march=native) and twice as many SSE2 ones without
+typedef uint64_t Screen_Rows __attribute__((vector_size(32)));
+#define SCREEN_ROWS_STEP (sizeof(Screen_Rows)/sizeof(uint64_t))
+
+_Static_assert(offsetof(Chip8, frame_buffer) % sizeof(Screen_Rows) == 0, "the planes must be aligned for Screen_Rows");
+
+// 00FB - SCR, 00FC - SCL: n pixels to the right (left when n < 0), in the current resolution
+static void screen_scroll_x(Chip8 *chip8, int n) {
+    for (int p = 0; p < FRAME_PLANES; p++) {
+        if (!((chip8->planes >> p) & 1)) continue;
+
+        Screen_Rows *lo = (Screen_Rows *) chip8->frame_buffer[p].lo;
+        Screen_Rows *hi = (Screen_Rows *) chip8->frame_buffer[p].hi;
+        if (!chip8->hires) {
+            for (size_t i = 0; i < FRAME_H/SCREEN_ROWS_STEP; i++) lo[i] = n > 0 ? lo[i] << n : lo[i] >> -n;
+        } else if (n > 0) {
+            for (size_t i = 0; i < HIRES_H/SCREEN_ROWS_STEP; i++) {
+                hi[i] = hi[i] << n | lo[i] >> (64 - n);
+                lo[i] = lo[i] << n;
+            }
+        } else {
+            for (size_t i = 0; i < HIRES_H/SCREEN_ROWS_STEP; i++) {
+                lo[i] = lo[i] >> -n | hi[i] << (64 + n);
+                hi[i] = hi[i] >> -n;
+            }
+        }
+    }
+
+    chip8->dirty_rows |= ALL_ROWS(chip8->hires);
+}
+
+// 00Cn - SCD, 00Dn - SCU: n rows down (up when n < 0), in the current resolution
+static void screen_scroll_y(Chip8 *chip8, int n) {
+    int h = SCREEN_H(chip8->hires);
+    size_t moved = (h - abs(n))*sizeof(uint64_t), cleared = abs(n)*sizeof(uint64_t);
+    for (int p = 0; p < FRAME_PLANES; p++) {
+        if (!((chip8->planes >> p) & 1)) continue;
+
+        uint64_t *halves[] = { chip8->frame_buffer[p].lo, chip8->frame_buffer[p].hi };
+        for (int i = 0; i < 2; i++) {
+            uint64_t *rows = halves[i];
+            if (n > 0) {
+                memmove(&rows[n], rows, moved);
+                memset(rows, 0, cleared);
+            } else {
+                memmove(rows, &rows[-n], moved);
+                memset(&rows[h + n], 0, cleared);
+            }
+        }
+    }
+
+    chip8->dirty_rows |= ALL_ROWS(chip8->hires);
+}
+
+// The Fx07 at pc reads the delay timer in a loop, `Fx07; SE Vx, kk; JP pc` or the same
+// with SNE. The timer only moves on the tick, so if the skip does not get out of the loop
+// now, it won't for the rest of the frame: the loop goes around and Vx keeps the same
+// value. Returns where pc is after the n instructions that follow the Fx07, or -1 when
+// there is no such loop at pc or it exits
+static int idle_loop_end(const Chip8 *chip8, uint16_t pc, int n) {
+    if (pc > MEMORY_SIZE - 6 || chip8->profile || chip8->trace) return -1;
+
+    Op skip = chip8_op_at(chip8, pc + 2);
+    Op jump = chip8_op_at(chip8, pc + 4);
+    if (op_decode(jump) != OP_JP_ADDR || (jump & 0x0FFF) != pc) return -1;
+    if ((skip & 0x0F00) != (chip8_op_at(chip8, pc) & 0x0F00)) return -1;
+
+    uint8_t kk = skip & 0x00FF;
+    Op_Type type = op_decode(skip);
+    bool loops = (type == OP_SE_RB && chip8->delay_timer != kk) ||
+                 (type == OP_SNE_R_B && chip8->delay_timer == kk);
+    if (!loops) return -1;
+
+    // the skip, the jump and the Fx07 again
+    static const uint8_t around[3] = { 2, 4, 0 };
+    return pc + around[n % 3];
+}
+
+int chip8_skip_idle(Chip8 *chip8, int n) {
+    uint16_t pc = chip8->pc;
+    if (n <= 0 || pc > MEMORY_SIZE - 2 || op_decode(chip8_op_at(chip8, pc)) != OP_LD_R_DT) return 0;
+
+    int end = idle_loop_end(chip8, pc, n - 1);
+    if (end < 0) return 0;
+
+    chip8->regs[chip8->memory[pc] & 0xF] = chip8->delay_timer;
+    chip8->pc = end;
+    chip8->cycles -= n;
+    chip8->idle = true;
+    chip8->idle_skipped += n;
+    return n;
+}
+
+Chip8_Status chip8_step(Chip8 *chip8) {
+    return chip8_run_cycles(chip8, 1);
+}
+
+Chip8_Status chip8_run_cycles(Chip8 *chip8, int n) {
+#if defined(PROFILE)
+    if (chip8->profile) return chip8_interpret(chip8, n);
+#endif
+#if defined(DEBUG)
+    if (chip8->trace) return chip8_interpret(chip8, n);
+#endif
+    if (chip8->jit) return chip8_jit_run(chip8, n);
+    return chip8_interpret(chip8, n);
+}
+
+#define INTERPRET interpret_chip8
+#define QUIRKS CHIP8_QUIRKS_CHIP8
+#include "chip8_interpret.h"
+
+#define INTERPRET interpret_vip
+#define QUIRKS CHIP8_QUIRKS_VIP
+#include "chip8_interpret.h"
+
+#define INTERPRET interpret_chip48
+#define QUIRKS CHIP8_QUIRKS_CHIP48
+#include "chip8_interpret.h"
+
+#define INTERPRET interpret_schip
+#define QUIRKS CHIP8_QUIRKS_SCHIP
+#include "chip8_interpret.h"
+
+#define INTERPRET interpret_xochip
+#define QUIRKS CHIP8_QUIRKS_XOCHIP
+#include "chip8_interpret.h"
+
+#if defined(PROFILE)
+#define PROFILING
+
+#define INTERPRET profile_chip8
+#define QUIRKS CHIP8_QUIRKS_CHIP8
+#include "chip8_interpret.h"
+
+#define INTERPRET profile_vip
+#define QUIRKS CHIP8_QUIRKS_VIP
+#include "chip8_interpret.h"
+
+#define INTERPRET profile_chip48
+#define QUIRKS CHIP8_QUIRKS_CHIP48
+#include "chip8_interpret.h"
+
+#define INTERPRET profile_schip
+#define QUIRKS CHIP8_QUIRKS_SCHIP
+#include "chip8_interpret.h"
+
+#define INTERPRET profile_xochip
+#define QUIRKS CHIP8_QUIRKS_XOCHIP
+#include "chip8_interpret.h"
+
+#undef PROFILING
+#endif
+
+// One branch per call picks the instance, there is none per instruction
+Chip8_Status chip8_interpret(Chip8 *chip8, int n) {
+#if defined(PROFILE)
+    if (chip8->profile) {
+        switch (chip8->quirks) {
+        case CHIP8_QUIRKS_VIP:    return profile_vip(chip8, n);
+        case CHIP8_QUIRKS_CHIP48: return profile_chip48(chip8, n);
+        case CHIP8_QUIRKS_SCHIP:  return profile_schip(chip8, n);
+        case CHIP8_QUIRKS_XOCHIP: return profile_xochip(chip8, n);
+        default:                  return profile_chip8(chip8, n);
+        }
+    }
+#endif
+    switch (chip8->quirks) {
+    case CHIP8_QUIRKS_VIP:    return interpret_vip(chip8, n);
+    case CHIP8_QUIRKS_CHIP48: return interpret_chip48(chip8, n);
+    case CHIP8_QUIRKS_SCHIP:  return interpret_schip(chip8, n);
+    case CHIP8_QUIRKS_XOCHIP: return interpret_xochip(chip8, n);
+    default:                  return interpret_chip8(chip8, n);
+    }
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
\ No newline at end of file
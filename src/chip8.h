@@ -0,0 +1,504 @@
+#ifndef CHIP8_H_
+#define CHIP8_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdio.h>
+
+// default number of instructions executed in each tick of the 60Hz clock
+#define CYCLES_PER_SEC 8
+
+// http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
+// 3.1 - Standard Chip-8 Instructions
+// 00E0 - CLS
+// 00EE - RET
+// 0nnn - SYS addr
+// 2nnn - CALL addr
+// 3xkk - SE Vx, byte
+// 5xy0 - SE Vx, Vy
+// 8xy1 - OR Vx, Vy
+// 8xy2 - AND Vx, Vy
+// 8xy3 - XOR Vx, Vy
+// 8xy5 - SUB Vx, Vy
+// 8xy6 - SHR Vx {, Vy}
+// 8xy7 - SUBN Vx, Vy
+// 8xyE - SHL Vx {, Vy}
+// 4xkk - SNE Vx, byte
+// 9xy0 - SNE Vx, Vy
+// 1nnn - JP addr
+// Bnnn - JP V0, addr
+// Cxkk - RND Vx, byte
+// Dxyn - DRW Vx, Vy, nibble
+// Ex9E - SKP Vx
+// ExA1 - SKNP Vx
+// 7xkk - ADD Vx, byte
+// 8xy4 - ADD Vx, Vy
+// Fx1E - ADD I, Vx
+// 6xkk - LD Vx, byte
+// 8xy0 - LD Vx, Vy
+// Annn - LD I, addr
+// Fx07 - LD Vx, DT
+// Fx0A - LD Vx, K
+// Fx15 - LD DT, Vx
+// Fx18 - LD ST, Vx
+// Fx29 - LD F, Vx
+// Fx33 - LD B, Vx
+// Fx55 - LD [I], Vx
+// Fx65 - LD Vx, [I]
+//
+// SUPER-CHIP (http://devernay.free.fr/hacks/chip8/schip.txt)
+// 00Cn - SCD nibble
+// 00FB - SCR
+// 00FC - SCL
+// 00FE - LOW
+// 00FF - HIGH
+// Dxy0 - DRW Vx, Vy, 0
+// Fx30 - LD HF, Vx
+//
+// XO-CHIP (https://johnearnest.github.io/Octo/docs/XO-ChipSpecification.html)
+// 00Dn - SCU nibble
+// Fn01 - PLANE n
+// F002 - AUDIO
+// Fx3A - PITCH Vx
+
+// The 00nn instructions come before SYS, the decoder takes the first match
+typedef enum {
+    OP_CLS = 0    ,
+    OP_RET        ,
+    OP_SCD        ,
+    OP_SCU        ,
+    OP_SCR        ,
+    OP_SCL        ,
+    OP_LOW        ,
+    OP_HIGH       ,
+    OP_SYS        ,
+    OP_CALL       ,
+    OP_SE_RB      ,
+    OP_SE_RR      ,
+    OP_OR         ,
+    OP_AND        ,
+    OP_XOR        ,
+    OP_SUB        ,
+    OP_SHR        ,
+    OP_SUBN       ,
+    OP_SHL        ,
+    OP_SNE_R_B    ,
+    OP_SNE_R_R    ,
+    OP_JP_ADDR    ,
+    OP_JP_V0_ADDR ,
+    OP_RND        ,
+    OP_DRW        ,
+    OP_SKP        ,
+    OP_SKNP       ,
+    OP_ADD_R_B    ,
+    OP_ADD_R_R    ,
+    OP_ADD_I_R    ,
+    OP_LD_R_B     ,
+    OP_LD_R_R     ,
+    OP_LD_I_ADDR  ,
+    OP_LD_R_DT    ,
+    OP_LD_R_K     ,
+    OP_LD_DT_R    ,
+    OP_LD_ST_R    ,
+    OP_LD_FONT_R  ,
+    OP_LD_BCD_R   ,
+    OP_LD_IMEM_R  ,
+    OP_LD_R_IMEM  ,
+    OP_LD_HF_R    ,
+    OP_PLANE      ,
+    OP_AUDIO      ,
+    OP_PITCH      ,
+    __OP_CNT__
+} Op_Type;
+
+typedef uint16_t Op;
+
+typedef struct {
+    uint16_t mask, value;
+} Op_Pattern;
+
+extern const Op_Pattern op_decode_table[__OP_CNT__];
+extern const char *op_names[__OP_CNT__];
+
+// - The sound and delay timers sequentially decrease at a rate of 1 per tick of a 60Hz clock. When the
+// sound timer is above 0, the sound will play as a single monotone beep.
+
+// - The framebuffer is an (x, y) addressable memory array that designates whether a pixel is currently on
+// or off. This will be implemented with a write address, an (x, y) position, a offset in the x direction,
+// and an 8-bit group of pixels to be drawn to the screen.
+
+// - The return address stack stores previous program counters when jumping into a new routine.
+
+// - The VF register is frequently used for storing carry values from a subtraction or addition action, and
+// also specifies whether a particular pixel is to be drawn on the screen.
+
+#define MEMORY_SIZE 0x1000
+#define STACK_SIZE 0x10
+#define FRAME_W 64
+#define FRAME_H 32
+#define FRAME_BUFFER_SIZE FRAME_H*FRAME_W
+// SUPER-CHIP high resolution, and the XO-CHIP bit planes
+#define HIRES_W 128
+#define HIRES_H 64
+#define FRAME_PLANES 2
+// size of the screen in either resolution
+#define SCREEN_W(hires) ((hires) ? HIRES_W : FRAME_W)
+#define SCREEN_H(hires) ((hires) ? HIRES_H : FRAME_H)
+// where Fx30 finds the 8x10 digits, right after the 4x5 ones at 0x000
+#define BIG_FONT_ADDR 0x050
+
+enum {
+    CHIP8_KEY_1 = 0b1000000000000000,
+    CHIP8_KEY_2 = 0b0100000000000000,
+    CHIP8_KEY_3 = 0b0010000000000000,
+    CHIP8_KEY_C = 0b0001000000000000,
+    CHIP8_KEY_4 = 0b0000100000000000,
+    CHIP8_KEY_5 = 0b0000010000000000,
+    CHIP8_KEY_6 = 0b0000001000000000,
+    CHIP8_KEY_D = 0b0000000100000000,
+    CHIP8_KEY_7 = 0b0000000010000000,
+    CHIP8_KEY_8 = 0b0000000001000000,
+    CHIP8_KEY_9 = 0b0000000000100000,
+    CHIP8_KEY_E = 0b0000000000010000,
+    CHIP8_KEY_A = 0b0000000000001000,
+    CHIP8_KEY_0 = 0b0000000000000100,
+    CHIP8_KEY_B = 0b0000000000000010,
+    CHIP8_KEY_F = 0b0000000000000001
+};
+
+// maps a chip8 key (0x0..0xF) to its bit in Chip8.keyboard
+extern const uint16_t chip8_key_masks[0x10];
+
+typedef enum {
+    CHIP8_OK = 0,
+    CHIP8_ERR_ROM_OPEN,
+    CHIP8_ERR_ROM_READ,
+    CHIP8_ERR_ROM_TOO_BIG,
+    CHIP8_ERR_STACK_OVERFLOW,
+    CHIP8_ERR_STACK_UNDERFLOW,
+    CHIP8_ERR_OUT_OF_BOUNDS,
+    CHIP8_ERR_INVALID_KEY,
+    CHIP8_ERR_NOT_IMPLEMENTED,
+    CHIP8_ERR_CONFIG,
+    CHIP8_ERR_INPUT_OPEN,
+    CHIP8_ERR_INPUT_FORMAT,
+    CHIP8_ERR_TRACE_OPEN,
+    CHIP8_ERR_WAV_OPEN,
+    __CHIP8_STATUS_CNT__
+} Chip8_Status;
+
+// An instruction unpacked once and kept until the memory under it is written.
+// handler is 0 while the slot is not decoded, otherwise the Op_Type + 1
+typedef struct {
+    uint8_t handler;
+    uint8_t x, y, n;
+    uint8_t kk;
+    uint16_t nnn;
+} Chip8_Decoded;
+
+typedef struct Chip8_Jit Chip8_Jit;
+
+// Quirk profiles: the behaviours the CHIP-8 implementations disagree on, see
+// https://chip8.gulrak.net/#quirks. Every profile runs on its own copy of the
+// interpreter with its quirks compiled in as constants (src/chip8_interpret.h)
+//
+//              8xy1-3   8xy6/E   Fx55/65     Bnnn        DRW       DRW waits for
+//              VF = 0   shifts   leave I at  jumps to    sprites   the next tick
+//   chip8      yes      Vy       I + x + 1   nnn + V0    clip      no
+//   vip        yes      Vy       I + x + 1   nnn + V0    clip      yes
+//   chip48     no       Vx       I + x       xnn + Vx    clip      no
+//   schip      no       Vx       I           xnn + Vx    clip      in 64x32
+//   xochip     no       Vy       I + x + 1   nnn + V0    wrap      no
+//
+// chip8 is the default, what this interpreter always ran: the VIP without the wait.
+// schip also sets VF after a DRW in 128x64 to the number of sprite rows that hit a lit
+// pixel or were clipped at the bottom, like SUPER-CHIP 1.1, where the others set it to 1
+typedef enum {
+    CHIP8_QUIRKS_CHIP8 = 0,
+    CHIP8_QUIRKS_VIP,
+    CHIP8_QUIRKS_CHIP48,
+    CHIP8_QUIRKS_SCHIP,
+    CHIP8_QUIRKS_XOCHIP,
+    __CHIP8_QUIRKS_CNT__
+} Chip8_Quirks;
+
+typedef enum {
+    CHIP8_I_PLUS_X_PLUS_1,
+    CHIP8_I_PLUS_X,
+    CHIP8_I_KEPT,
+} Chip8_Load_Store;
+
+typedef enum {
+    CHIP8_WAIT_NEVER,
+    CHIP8_WAIT_ALWAYS,
+    CHIP8_WAIT_LORES,
+} Chip8_Display_Wait;
+
+typedef struct {
+    const char *name;
+    bool vf_reset;
+    bool shift_vx;
+    Chip8_Load_Store load_store;
+    bool jump_vx;
+    bool wrap;
+    Chip8_Display_Wait display_wait;
+    bool row_hits;
+} Chip8_Quirk_Set;
+
+extern const Chip8_Quirk_Set chip8_quirk_sets[__CHIP8_QUIRKS_CNT__];
+
+// A bit plane of the screen, with rows of 128 pixels in two words: column x of row y is
+// bit x of lo[y], or bit x - 64 of hi[y] from column 64 on. In low resolution only the
+// top left 64x32 is used, lo[0..FRAME_H), laid out as the CHIP-8 screen always was
+typedef struct {
+    uint64_t lo[HIRES_H];
+    uint64_t hi[HIRES_H];
+} Chip8_Plane;
+
+// Counters of the interpreter, only filled in builds with -DPROFILE (make DEFINES=PROFILE)
+typedef struct {
+    // The ways into each address other than from the instruction before it: jumps, calls,
+    // skips (taken or not) and the start of a run, less the end of a run (its next
+    // instruction was got to, but did not run). Straight-line code is not counted at all:
+    // the hits of an address are its entries plus the hits of the instruction before it,
+    // when that one goes on to it, a CALL through its RET. See chip8_profile_hits
+    uint64_t entries[MEMORY_SIZE];
+    // Instructions executed by type, the last one counts the words that are not instructions.
+    // The hits at an even address are only added here when its decoded instruction is
+    // dropped; pc_counted has the hits already added. chip8_profile_ops gives the complete counts
+    uint64_t ops[__OP_CNT__ + 1];
+    uint64_t pc_counted[MEMORY_SIZE];
+    // Of the hits in pc_counted, the ones that went on to the next instruction. The code
+    // there may be something else by now
+    uint64_t flowed[MEMORY_SIZE];
+    // Bnnn by the address it went to, the only jump whose target is neither in the
+    // instruction nor the one after a CALL, and the pc the machine was put at by
+    // chip8_profile_enable and chip8_load_state. With the hits of JP and CALL they tell
+    // the entries of the skips apart, see chip8_profile_skips
+    uint64_t dynamic_jumps[MEMORY_SIZE];
+    // DRW that turned a pixel off, so set VF
+    uint64_t draw_collisions;
+    // Skips by type, settled with the code that ran them whenever a skip is written over or
+    // the machine leaves its state, and the hits, jumps into every address and pc they were
+    // settled at. See chip8_profile_skips
+    uint64_t skips_taken[__OP_CNT__];
+    uint64_t skips_not_taken[__OP_CNT__];
+    uint64_t settled_hits[MEMORY_SIZE];
+    uint64_t settled_jumps[MEMORY_SIZE];
+    uint16_t settled_pc;
+} Chip8_Profile;
+
+// An instruction of the execution trace, with the machine as it was right before it
+// ran. Only written in builds with -DDEBUG
+typedef struct {
+    // instructions executed before it, since the trace was enabled
+    uint64_t cycle;
+    uint16_t pc;
+    Op op;
+    uint16_t regi;
+    int8_t sp;
+    uint8_t regs[0x10];
+} Chip8_Trace_Record;
+
+typedef struct {
+    // ring of the newest records, its size is a power of two
+    Chip8_Trace_Record *records;
+    uint64_t mask;
+    // records written so far, the newest is at (count - 1) & mask
+    uint64_t count;
+    // instructions executed by the previous calls of the interpreter
+    uint64_t cycle;
+} Chip8_Trace;
+
+typedef struct {
+    // Hot: what the interpreter reads and writes on almost every instruction, kept
+    // together in the first cache line and away from memory and the frame buffer
+    _Alignas(64) uint8_t regs[0x10];
+    uint16_t pc;
+    uint16_t regi;
+    int8_t sp;
+    uint8_t delay_timer;
+    uint8_t sound_timer;
+    bool waiting_for_key;
+    // register that receives the key of a pending Fx0A
+    uint8_t key_reg;
+    // set by the 60Hz tick when any row changed since the last tick
+    bool should_draw;
+    bool update_audio_state;
+    uint16_t keyboard;
+    // instructions left in the current frame, refilled with ipf on every tick
+    int cycles;
+    int ipf;
+    // xorshift state behind Cxkk, see chip8_seed
+    uint32_t rng;
+    // 128x64 instead of 64x32 (00FF), and the planes DRW, CLS and the scrolls work on
+    // (Fn01), bit p for plane p
+    bool hires;
+    uint8_t planes;
+    // Chip8_Quirks, see chip8_set_quirks
+    uint8_t quirks;
+    // set by a DRW of a profile with the display wait, until the next tick
+    bool waiting_for_vblank;
+    // set when the rest of the current run budget (the n of chip8_run_cycles) went by in
+    // an idle loop, see chip8_skip_idle. The loop can not exit before the next tick, which
+    // clears it, so more runs until then only move pc and the cycles
+    bool idle;
+    // bit y is set when row y of the screen changed, see chip8_take_dirty_rows
+    uint64_t dirty_rows;
+
+    // Cold: only touched by CALL/RET, DRW/CLS, the scrolls and the memory ops
+    uint16_t stack[STACK_SIZE];
+    _Alignas(32) Chip8_Plane frame_buffer[FRAME_PLANES];
+    uint8_t memory[MEMORY_SIZE];
+    // XO-CHIP audio: 128 one-bit samples played in a loop at 4000*2^((pitch - 64)/48)
+    // samples per second while the sound timer runs. Roms that never run F002 get
+    // the plain beep instead
+    uint8_t audio_pattern[16];
+    uint8_t pitch;
+    bool has_pattern;
+    // cycles left in the frame right after the last Fx18, F002 or Fx3A, which places
+    // the change of sound inside the frame
+    int sound_cycles_left;
+
+    // predecoded instruction for every even address of memory
+    Chip8_Decoded decoded[MEMORY_SIZE/2];
+    // native code cache, only when chip8_jit_enable was called
+    Chip8_Jit *jit;
+    // only when chip8_profile_enable was called
+    Chip8_Profile *profile;
+    // only when chip8_trace_enable was called
+    Chip8_Trace *trace;
+    // instructions of idle loops that were skipped over instead of executed, they are
+    // counted in the cycles all the same
+    uint64_t idle_skipped;
+} Chip8;
+
+// Everything that makes up a running machine: Chip8 up to (not including) the caches.
+// Good for savestates in memory or on disk as long as the struct doesn't change
+#define CHIP8_STATE_SIZE offsetof(Chip8, decoded)
+typedef struct {
+    uint8_t bytes[CHIP8_STATE_SIZE];
+} Chip8_State;
+
+void chip8_save_state(const Chip8 *chip8, Chip8_State *state);
+// Restores a saved state. Only the code that differs is invalidated, and the whole
+// screen is marked dirty
+void chip8_load_state(Chip8 *chip8, const Chip8_State *state);
+
+// Resets the machine: clears the state, loads the fonts and points pc to 0x200
+void chip8_init(Chip8 *chip8);
+Chip8_Status chip8_load_rom(Chip8 *chip8, const char *rom);
+Chip8_Status chip8_load_rom_memory(Chip8 *chip8, const uint8_t *rom, size_t size);
+// Seeds the generator behind Cxkk. Every machine has its own, so runs with the same
+// seed and input are reproducible and machines can run on different threads
+void chip8_seed(Chip8 *chip8, uint64_t seed);
+// Applies the per-ROM settings found next to the rom (games/Foo.ch8 -> games/Foo.conf),
+// one `key = value` per line, `#` starts a comment. A missing file is not an error.
+//     ipf = 15         # instructions per frame
+//     quirks = schip   # quirk profile, see Chip8_Quirks
+Chip8_Status chip8_load_config(Chip8 *chip8, const char *rom);
+// The profile with that name (chip8, vip, chip48, schip, xochip), or __CHIP8_QUIRKS_CNT__
+Chip8_Quirks chip8_quirks_find(const char *name);
+// Switches the interpreter (and the code the JIT made) to another quirk profile
+void chip8_set_quirks(Chip8 *chip8, Chip8_Quirks quirks);
+
+// Executes a single instruction. On error, pc is left pointing to the faulting instruction
+Chip8_Status chip8_step(Chip8 *chip8);
+// Executes up to n instructions, stopping early on error, when an Fx0A is waiting for a key
+// or when a DRW is waiting for the next tick (display wait quirk)
+Chip8_Status chip8_run_cycles(Chip8 *chip8, int n);
+
+// When pc is at an idle loop, `Fx07; SE Vx, kk; JP pc` (or SNE) polling the delay timer
+// that can not exit before the next tick, runs its n instructions at once: pc, Vx and
+// cycles end up as executing them would leave them, and chip8->idle is set. Returns the
+// instructions skipped, 0 when pc is not at such a loop. The interpreter does it by
+// itself, this is for the other engines
+int chip8_skip_idle(Chip8 *chip8, int n);
+
+// The threaded interpreter behind chip8_run_cycles when the JIT is off, the instance of
+// the machine's quirk profile
+Chip8_Status chip8_interpret(Chip8 *chip8, int n);
+
+// Optional x86-64 recompiler. Once enabled, chip8_run_cycles runs translated basic
+// blocks and uses the interpreter for what the JIT does not handle. Must be enabled
+// after chip8_init. Returns false when the host is not supported
+bool chip8_jit_enable(Chip8 *chip8);
+void chip8_jit_disable(Chip8 *chip8);
+Chip8_Status chip8_jit_run(Chip8 *chip8, int n);
+void chip8_jit_invalidate(Chip8_Jit *jit, uint16_t addr, uint16_t len);
+
+// Optional profiler. Once enabled, every instruction shows up in chip8->profile, and
+// chip8_run_cycles always uses the interpreter so nothing goes uncounted. Returns false
+// when the core was built without -DPROFILE; without it the interpreter has no trace of
+// the profiler at all
+bool chip8_profile_enable(Chip8 *chip8);
+void chip8_profile_disable(Chip8 *chip8);
+// Writes the counters as JSON, and as folded stacks (`root;OP_TYPE;0xPC count` per
+// address) for flamegraph.pl and friends. The op at each address is read from memory
+void chip8_profile_write_json(const Chip8 *chip8, FILE *file);
+// Instructions executed by type so far, __OP_CNT__ + 1 of them (see Chip8_Profile.ops)
+void chip8_profile_ops(const Chip8 *chip8, uint64_t *ops);
+// Instructions executed at every address so far (MEMORY_SIZE of them), from the entries
+void chip8_profile_hits(const Chip8 *chip8, uint64_t *hits);
+// The same for one address, walking back to the start of its straight-line code
+uint64_t chip8_profile_hits_at(const Chip8 *chip8, uint16_t pc);
+// Skips taken and not taken so far by type (__OP_CNT__ of each). A skip at pc that was not
+// taken is a hit at pc + 2 that did not come from a jump or from a skip taken at pc - 2
+void chip8_profile_skips(const Chip8 *chip8, uint64_t *taken, uint64_t *not_taken);
+void chip8_profile_write_folded(const Chip8 *chip8, const char *root, FILE *file);
+// Called by the core: the code from first to last (even addresses) is about to be dropped,
+// and the machine is leaving its state for another one and arriving in it (chip8_load_state)
+void chip8_profile_invalidate(Chip8 *chip8, uint16_t first, uint16_t last);
+void chip8_profile_leave(Chip8 *chip8);
+void chip8_profile_arrive(Chip8 *chip8);
+
+// Optional execution trace. Once enabled, the interpreter writes a Chip8_Trace_Record of
+// every instruction to a ring that keeps the newest ones (records, rounded up to a power
+// of two), and chip8_run_cycles always uses the interpreter. Returns false when the core
+// was built without -DDEBUG or there is no memory for the ring
+bool chip8_trace_enable(Chip8 *chip8, size_t records);
+void chip8_trace_disable(Chip8 *chip8);
+// Writes the ring to path, oldest record first, and the current state last. Can be
+// called at any time, bin/trace_dump prints the file
+Chip8_Status chip8_trace_write(const Chip8 *chip8, const char *path);
+
+// Drops the predecoded instructions overlapping [addr, addr + len). Must be called by
+// anyone writing to memory outside of the interpreter
+void chip8_invalidate_code(Chip8 *chip8, uint16_t addr, uint16_t len);
+
+// One tick of the 60Hz clock: decreases the timers, refills the cycles budget and ends
+// a display wait or an idle frame
+void chip8_tick_frame(Chip8 *chip8);
+// Updates the pressed keys. Releasing a key resolves a pending Fx0A
+void chip8_set_keyboard(Chip8 *chip8, uint16_t keyboard);
+
+Op chip8_op_at(const Chip8 *chip8, uint16_t addr);
+// Builds the decode lookup table. chip8_init calls it, so it only has to be called
+// directly when op_decode is used without a machine
+void op_decode_init(void);
+// Both return __OP_CNT__ for words that are not valid instructions
+Op_Type op_decode(Op op);
+Op_Type op_decode_scan(Op op);
+// Whether the pixel at (x, y) of the screen in the current resolution is lit on any plane
+bool is_pixel_active(const Chip8 *chip8, int x, int y);
+void chip8_dump(const Chip8 *chip8);
+const char *chip8_status_name(Chip8_Status status);
+// FNV-1a of the screen, to compare screens without keeping them. A 64x32 screen with
+// nothing on the second plane hashes as the CHIP-8 frame buffer always did
+uint64_t chip8_frame_hash(const Chip8 *chip8);
+// Writes the screen as SCREEN_W*SCREEN_H pixels of the current resolution, row by row,
+// left to right: on for the lit pixels (on any plane) and off for the others. The values
+// are opaque, so any 32-bit pixel format works (e.g. RGBA8 to upload as a texture)
+void chip8_frame_expand(const Chip8 *chip8, uint32_t *pixels, uint32_t on, uint32_t off);
+// Same, but only for the rows set in rows (bit y for row y), the others are left alone
+void chip8_frame_expand_rows(const Chip8 *chip8, uint32_t *pixels, uint64_t rows, uint32_t on, uint32_t off);
+// Same, from a copy of the planes (e.g. one handed to another thread), with a color for
+// each combination of planes: colors[0] where none is lit, colors[1] for the first plane
+// only, colors[2] for the second only and colors[3] for both
+void chip8_planes_expand_rows(const Chip8_Plane *planes, bool hires, uint32_t *pixels, uint64_t rows, const uint32_t colors[4]);
+// Returns the rows drawn to since the last call (all of them after chip8_init or a change
+// of resolution) and clears them. A frame with no dirty row is the same as the previous one
+uint64_t chip8_take_dirty_rows(Chip8 *chip8);
+
+#endif // CHIP8_H_
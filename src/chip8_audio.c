@@ -0,0 +1,265 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <math.h>
+
+#include "chip8_audio.h"
+
+#define WAVETABLE_BITS 8
+#define BEEP_AMPLITUDE 32000
+#define PATTERN_AMPLITUDE 12000
+// the pattern is 128 = 2^7 bits, a bit is 2^25 of the phase
+#define PATTERN_BIT_SHIFT 25
+#define WAV_HEADER_SIZE 44
+#define QUEUE_MASK (CHIP8_SOUND_QUEUE - 1)
+
+_Static_assert(CHIP8_AUDIO_WAVETABLE == 1 << WAVETABLE_BITS, "the wavetable is indexed by the top bits of the phase");
+
+// Phase step of something that turns hz times a second
+static uint32_t phase_step(double hz, int sample_rate) {
+    return (uint32_t) (hz*4294967296.0/sample_rate);
+}
+
+// XO-CHIP plays the 128 bits at 4000*2^((pitch - 64)/48) per second
+static uint32_t pattern_step(uint8_t pitch, int sample_rate) {
+    double bits_per_sec = 4000.0*exp2((pitch - 64)/48.0);
+    return phase_step(bits_per_sec/128, sample_rate);
+}
+
+void chip8_audio_init(Chip8_Audio *audio, int sample_rate) {
+    memset(audio, 0, sizeof(*audio));
+    audio->sample_rate = sample_rate;
+    audio->pitch = 64;
+    audio->beep_step = phase_step(CHIP8_AUDIO_BEEP_HZ, sample_rate);
+    audio->pattern_step = pattern_step(audio->pitch, sample_rate);
+    audio->latency = sample_rate/60;
+    for (int i = 0; i < CHIP8_AUDIO_WAVETABLE; i++) {
+        audio->wavetable[i] = (int16_t) lrint(BEEP_AMPLITUDE*sin(2*M_PI*i/CHIP8_AUDIO_WAVETABLE));
+    }
+}
+
+static Chip8_Sound_Event sound_of(const Chip8 *chip8, uint64_t at) {
+    Chip8_Sound_Event event = {
+        .at = at,
+        .playing = chip8->sound_timer > 0,
+        .has_pattern = chip8->has_pattern,
+        .pitch = chip8->pitch,
+    };
+    memcpy(event.pattern, chip8->audio_pattern, sizeof(event.pattern));
+    return event;
+}
+
+static void set_sound(Chip8_Audio *audio, const Chip8_Sound_Event *event) {
+    // every sound starts at the same point of the wave, so renders are reproducible
+    if (event->playing && !audio->playing) audio->phase = 0;
+    audio->playing = event->playing;
+
+    audio->has_pattern = event->has_pattern;
+    memcpy(audio->pattern, event->pattern, sizeof(audio->pattern));
+    if (event->pitch != audio->pitch) {
+        audio->pitch = event->pitch;
+        audio->pattern_step = pattern_step(audio->pitch, audio->sample_rate);
+    }
+}
+
+void chip8_audio_update(Chip8_Audio *audio, const Chip8 *chip8) {
+    Chip8_Sound_Event event = sound_of(chip8, 0);
+    set_sound(audio, &event);
+}
+
+void chip8_audio_render(Chip8_Audio *audio, int16_t *samples, int count) {
+    if (!audio->playing) {
+        memset(samples, 0, count*sizeof(*samples));
+        return;
+    }
+
+    uint32_t phase = audio->phase;
+    if (!audio->has_pattern) {
+        uint32_t step = audio->beep_step;
+        for (int i = 0; i < count; i++) {
+            samples[i] = audio->wavetable[phase >> (32 - WAVETABLE_BITS)];
+            phase += step;
+        }
+
+        audio->phase = phase;
+        return;
+    }
+
+    // A bit of the pattern holds for several samples (11 at 44.1kHz and the default
+    // pitch), so the samples are filled a run of the same bit at a time, in a loop of
+    // plain stores the compiler vectorises
+    uint32_t step = audio->pattern_step;
+    int i = 0;
+    while (i < count) {
+        uint32_t bit = phase >> PATTERN_BIT_SHIFT;
+        uint64_t left = ((uint64_t) (bit + 1) << PATTERN_BIT_SHIFT) - phase;
+        uint64_t run = (left + step - 1)/step;
+        int n = run < (uint64_t) (count - i) ? (int) run : count - i;
+
+        int16_t v = (audio->pattern[bit >> 3] >> (7 - (bit & 7))) & 1 ? PATTERN_AMPLITUDE : -PATTERN_AMPLITUDE;
+        int16_t *out = samples + i;
+        for (int k = 0; k < n; k++) out[k] = v;
+
+        i += n;
+        phase += (uint32_t) n*step;
+    }
+
+    audio->phase = phase;
+}
+
+void chip8_sound_queue_init(Chip8_Sound_Queue *queue) {
+    memset(queue, 0, sizeof(*queue));
+}
+
+uint64_t chip8_sound_time(const Chip8 *chip8, uint64_t frame_start, int frame_samples) {
+    if (chip8->ipf <= 0) return frame_start;
+
+    // in turbo mode a frame runs more than ipf, those changes go at its end
+    int done = chip8->ipf - chip8->sound_cycles_left;
+    if (done < 0) done = 0;
+    if (done > chip8->ipf) done = chip8->ipf;
+    return frame_start + (uint64_t) done*frame_samples/chip8->ipf;
+}
+
+bool chip8_sound_push(Chip8_Sound_Queue *queue, const Chip8 *chip8, uint64_t at) {
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head == CHIP8_SOUND_QUEUE) return false;
+
+    queue->events[tail & QUEUE_MASK] = sound_of(chip8, at);
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+void chip8_sound_publish(Chip8_Sound_Queue *queue, uint64_t horizon) {
+    atomic_store_explicit(&queue->horizon, horizon, memory_order_release);
+}
+
+void chip8_audio_render_queue(Chip8_Audio *audio, Chip8_Sound_Queue *queue, int16_t *samples, int count) {
+    // the horizon first: every event pushed before it is then in tail
+    uint64_t horizon = atomic_load_explicit(&queue->horizon, memory_order_acquire);
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+
+    // Too far behind the emulation (the device started late, or stalled): skip to
+    // latency behind it. The changes skipped over still apply, without being heard
+    if (horizon > audio->clock + 2*(uint64_t) audio->latency) {
+        audio->clock = horizon - audio->latency;
+        atomic_fetch_add_explicit(&queue->resyncs, 1, memory_order_relaxed);
+    }
+
+    int i = 0;
+    while (i < count) {
+        while (head != tail && queue->events[head & QUEUE_MASK].at <= audio->clock) {
+            set_sound(audio, &queue->events[head & QUEUE_MASK]);
+            head++;
+        }
+
+        // up to the next change
+        int n = count - i;
+        if (head != tail) {
+            uint64_t until = queue->events[head & QUEUE_MASK].at - audio->clock;
+            if (until < (uint64_t) n) n = (int) until;
+        }
+
+        chip8_audio_render(audio, samples + i, n);
+        audio->clock += n;
+        i += n;
+    }
+
+    atomic_store_explicit(&queue->head, head, memory_order_release);
+
+    // Played past what the emulation has done, holding the last sound: the clock goes
+    // back to latency behind the horizon, so the changes still to come land where they
+    // should and the next buffers have the room again
+    if (audio->clock > horizon) {
+        uint64_t latency = audio->latency;
+        // until the emulation is latency ahead there is nothing to be late for
+        if (horizon < latency) {
+            audio->clock = 0;
+        } else {
+            audio->clock = horizon - latency;
+            atomic_fetch_add_explicit(&queue->underruns, 1, memory_order_relaxed);
+        }
+    }
+}
+
+static uint8_t *put(uint8_t *p, uint32_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) *p++ = v >> (8*i);
+    return p;
+}
+
+// RIFF header of a 16-bit mono PCM wav with the given number of samples
+static void wav_header(uint8_t *header, int sample_rate, uint32_t samples) {
+    uint8_t *p = header;
+    memcpy(p, "RIFF", 4), p += 4;
+    p = put(p, WAV_HEADER_SIZE - 8 + samples*2, 4);
+    memcpy(p, "WAVEfmt ", 8), p += 8;
+    p = put(p, 16, 4);              // size of the fmt chunk
+    p = put(p, 1, 2);               // PCM
+    p = put(p, 1, 2);               // mono
+    p = put(p, sample_rate, 4);
+    p = put(p, sample_rate*2, 4);   // bytes per second
+    p = put(p, 2, 2);               // bytes per sample
+    p = put(p, 16, 2);              // bits per sample
+    memcpy(p, "data", 4), p += 4;
+    put(p, samples*2, 4);
+}
+
+Chip8_Status chip8_wav_open(Chip8_Wav *wav, const char *path, int sample_rate) {
+    *wav = (Chip8_Wav) { .path = path, .sample_rate = sample_rate };
+    wav->file = fopen(path, "wb");
+    if (wav->file == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        return CHIP8_ERR_WAV_OPEN;
+    }
+
+    // the sizes are patched in by chip8_wav_close
+    uint8_t header[WAV_HEADER_SIZE];
+    wav_header(header, sample_rate, 0);
+    wav->failed = fwrite(header, 1, sizeof(header), wav->file) != sizeof(header);
+    return CHIP8_OK;
+}
+
+void chip8_wav_write(Chip8_Wav *wav, const int16_t *samples, int count) {
+    uint8_t bytes[4096];
+    while (count > 0 && !wav->failed) {
+        int n = count < (int) sizeof(bytes)/2 ? count : (int) sizeof(bytes)/2;
+        for (int i = 0; i < n; i++) put(bytes + 2*i, (uint16_t) samples[i], 2);
+        wav->failed = fwrite(bytes, 2, n, wav->file) != (size_t) n;
+        wav->samples += n;
+        samples += n;
+        count -= n;
+    }
+}
+
+Chip8_Status chip8_wav_close(Chip8_Wav *wav) {
+    if (!wav->failed) {
+        uint8_t header[WAV_HEADER_SIZE];
+        wav_header(header, wav->sample_rate, wav->samples);
+        wav->failed = fseek(wav->file, 0, SEEK_SET) != 0 ||
+                      fwrite(header, 1, sizeof(header), wav->file) != sizeof(header);
+    }
+
+    if (fclose(wav->file) != 0) wav->failed = true;
+    wav->file = NULL;
+    if (wav->failed) {
+        fprintf(stderr, "ERROR: could not write wav %s: %s\n", wav->path, strerror(errno));
+        return CHIP8_ERR_WAV_OPEN;
+    }
+
+    return CHIP8_OK;
+}
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
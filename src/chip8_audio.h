@@ -0,0 +1,114 @@
+#ifndef CHIP8_AUDIO_H_
+#define CHIP8_AUDIO_H_
+
+#include <stdio.h>
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+// Sound of a machine as 16-bit mono samples. The beep is one cycle of a sine kept in a
+// wavetable and walked by a phase accumulator, XO-CHIP patterns are played the same way
+// with the 128 bits as the table. All the state is in Chip8_Audio, so there can be one
+// per machine and any number of them at once.
+//
+//     Chip8_Audio audio;
+//     chip8_audio_init(&audio, 44100);
+//     ... every frame, after running it: chip8_audio_update(&audio, &chip8);
+//     ... chip8_audio_render(&audio, samples, 44100/60);
+//
+// That is only as precise as a frame. For sound that starts and stops at the sample it
+// should, the emulation pushes the changes with their time into a Chip8_Sound_Queue
+// and chip8_audio_render_queue plays them, on another thread if needed:
+//
+//     emulation                                      audio callback
+//     chip8_sound_push(&queue, &chip8, when);        chip8_audio_render_queue(&audio, &queue, samples, n);
+//     chip8_sound_publish(&queue, next_frame_start);
+//
+// Times are samples of the emulated clock: frame f starts at f*sample_rate/60
+
+#define CHIP8_AUDIO_BEEP_HZ 440
+#define CHIP8_AUDIO_WAVETABLE 256
+
+typedef struct {
+    int sample_rate;
+    // a full turn of the wavetable, or of the pattern, is 2^32
+    uint32_t phase;
+
+    // what is playing, copied from the machine by chip8_audio_update
+    bool playing;
+    bool has_pattern;
+    uint8_t pattern[16];
+    uint8_t pitch;
+    // phase step per sample of the beep, and of the pattern at pitch
+    uint32_t beep_step;
+    uint32_t pattern_step;
+
+    int16_t wavetable[CHIP8_AUDIO_WAVETABLE];
+
+    // chip8_audio_render_queue: the emulated time of the next sample, and how far it
+    // stays behind what the emulation published (one frame by default)
+    uint64_t clock;
+    int latency;
+} Chip8_Audio;
+
+typedef struct {
+    uint64_t at;
+    bool playing;
+    bool has_pattern;
+    uint8_t pitch;
+    uint8_t pattern[16];
+} Chip8_Sound_Event;
+
+// a power of two
+#define CHIP8_SOUND_QUEUE 256
+
+// Lock-free queue of sound changes from one producer (the emulation) to one consumer
+// (the audio). Every counter only ever grows
+typedef struct {
+    Chip8_Sound_Event events[CHIP8_SOUND_QUEUE];
+    // written by the producer: events pushed, and the time up to which all of the
+    // events are in
+    _Alignas(64) _Atomic uint64_t tail;
+    _Atomic uint64_t horizon;
+    // written by the consumer: events played, times it ran out of published time and
+    // held the last sound, and times it fell too far behind and skipped ahead
+    _Alignas(64) _Atomic uint64_t head;
+    _Atomic uint64_t underruns;
+    _Atomic uint64_t resyncs;
+} Chip8_Sound_Queue;
+
+void chip8_audio_init(Chip8_Audio *audio, int sample_rate);
+// Takes the sound timer, pattern and pitch of chip8 as they are now
+void chip8_audio_update(Chip8_Audio *audio, const Chip8 *chip8);
+// Writes the next count samples, silence when the sound timer is not running
+void chip8_audio_render(Chip8_Audio *audio, int16_t *samples, int count);
+
+void chip8_sound_queue_init(Chip8_Sound_Queue *queue);
+// Where the last sound change of chip8 (update_audio_state after running a frame that
+// started at frame_start) falls: at its instruction, assuming the ipf instructions of
+// a frame are spread evenly over its frame_samples
+uint64_t chip8_sound_time(const Chip8 *chip8, uint64_t frame_start, int frame_samples);
+// Queues the sound of chip8 from time at on. Times must not go back. Returns false,
+// dropping the change, when the queue is full
+bool chip8_sound_push(Chip8_Sound_Queue *queue, const Chip8 *chip8, uint64_t at);
+// Every change before horizon has been pushed
+void chip8_sound_publish(Chip8_Sound_Queue *queue, uint64_t horizon);
+// Writes the next count samples, applying each queued change at its sample
+void chip8_audio_render_queue(Chip8_Audio *audio, Chip8_Sound_Queue *queue, int16_t *samples, int count);
+
+// A .wav of 16-bit mono samples written as they come, for rendering offline. The sizes
+// in the header are only right after chip8_wav_close
+typedef struct {
+    FILE *file;
+    const char *path;
+    int sample_rate;
+    uint32_t samples;
+    bool failed;
+} Chip8_Wav;
+
+Chip8_Status chip8_wav_open(Chip8_Wav *wav, const char *path, int sample_rate);
+void chip8_wav_write(Chip8_Wav *wav, const int16_t *samples, int count);
+// Reports any error of the writes too
+Chip8_Status chip8_wav_close(Chip8_Wav *wav);
+
+#endif // CHIP8_AUDIO_H_
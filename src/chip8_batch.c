@@ -0,0 +1,353 @@
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "chip8_batch.h"
+#include "chip8_lanes.h"
+
+// The queue of a worker is the range [lo, hi) of units (instances, or groups of
+// CHIP8_LANES instances in lockstep mode) it still has to run, packed
+// in a single word so the owner taking from the bottom and thieves taking the upper half
+// both go through one CAS. Nothing is ever pushed back, so a worker is done once its own
+// range and everybody else's are empty.
+#define RANGE(lo, hi) ((uint64_t) (hi) << 32 | (uint32_t) (lo))
+#define RANGE_LO(r) ((uint32_t) (r))
+#define RANGE_HI(r) ((uint32_t) ((r) >> 32))
+
+typedef struct {
+    // own cache line, it is hammered by the owner and read by every thief
+    _Alignas(64) _Atomic uint64_t range;
+    uint64_t steals;
+    uint64_t vector_ops, scalar_ops;
+} Worker;
+
+typedef struct {
+    Chip8_Batch *batch;
+    Worker *workers;
+    int worker_cnt;
+    uint32_t frames;
+    Chip8_Batch_Input input;
+    void *user;
+} Batch_Run;
+
+typedef struct {
+    Batch_Run *run;
+    int id;
+} Worker_Arg;
+
+bool chip8_batch_init(Chip8_Batch *batch, size_t count) {
+    memset(batch, 0, sizeof(*batch));
+    if (count == 0 || count > UINT32_MAX) return false;
+
+    batch->machines = aligned_alloc(64, (count*sizeof(Chip8) + 63)/64*64);
+    batch->results = calloc(count, sizeof(Chip8_Result));
+    if (batch->machines == NULL || batch->results == NULL) {
+        chip8_batch_free(batch);
+        return false;
+    }
+
+    batch->count = count;
+    for (size_t i = 0; i < count; i++) {
+        chip8_init(&batch->machines[i]);
+    }
+
+    return true;
+}
+
+void chip8_batch_free(Chip8_Batch *batch) {
+    if (batch->machines != NULL) {
+        for (size_t i = 0; i < batch->count; i++) {
+            chip8_jit_disable(&batch->machines[i]);
+        }
+    }
+
+    free(batch->machines);
+    free(batch->results);
+    memset(batch, 0, sizeof(*batch));
+}
+
+// Renders the sound of a frame of chip8 and chains its samples into hash (FNV-1a on
+// 64-bit words, a frame at a time is a lot of samples)
+static uint64_t hash_audio(Chip8_Audio *audio, const Chip8 *chip8, int rate, uint64_t hash) {
+    int16_t samples[(CHIP8_BATCH_MAX_AUDIO_RATE/60 + 3)/4*4] = {0};
+    int count = (rate < CHIP8_BATCH_MAX_AUDIO_RATE ? rate : CHIP8_BATCH_MAX_AUDIO_RATE)/60;
+    chip8_audio_update(audio, chip8);
+    chip8_audio_render(audio, samples, count);
+
+    for (int i = 0; i < count; i += 4) {
+        uint64_t word;
+        memcpy(&word, &samples[i], sizeof(word));
+        hash = (hash ^ word)*0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static void run_instance(Batch_Run *run, size_t i) {
+    Chip8 *chip8 = &run->batch->machines[i];
+    Chip8_Status status = CHIP8_OK;
+    uint64_t instructions = 0;
+    int rate = run->batch->audio_rate;
+    Chip8_Audio audio;
+    uint64_t audio_hash = 0;
+    if (rate) {
+        chip8_audio_init(&audio, rate);
+        audio_hash = 0xcbf29ce484222325ull;
+    }
+
+    uint32_t frame;
+    for (frame = 0; frame < run->frames; frame++) {
+        if (run->input != NULL) {
+            chip8_set_keyboard(chip8, run->input(i, frame, run->user));
+        }
+
+        int before = chip8->cycles;
+        status = chip8_run_cycles(chip8, chip8->cycles);
+        instructions += before - chip8->cycles;
+        if (status != CHIP8_OK) break;
+
+        if (rate) audio_hash = hash_audio(&audio, chip8, rate, audio_hash);
+        chip8_tick_frame(chip8);
+    }
+
+    run->batch->results[i] = (Chip8_Result) {
+        .status = status,
+        .pc = chip8->pc,
+        .frames = frame,
+        .instructions = instructions,
+        .frame_hash = chip8_frame_hash(chip8),
+        .audio_hash = audio_hash,
+    };
+}
+
+// Same as run_instance on each machine of the group, with the frames of the machines
+// still running executed together by chip8_lanes_run
+static void run_group(Batch_Run *run, Worker *worker, size_t group) {
+    Chip8_Batch *batch = run->batch;
+    size_t first = group*CHIP8_LANES;
+    int count = batch->count - first < CHIP8_LANES ? batch->count - first : CHIP8_LANES;
+
+    Chip8_Lanes lanes = {0};
+    Chip8 *machines[CHIP8_LANES];
+    size_t ids[CHIP8_LANES];
+    Chip8_Status status[CHIP8_LANES];
+    uint64_t instructions[CHIP8_LANES] = {0};
+    int before[CHIP8_LANES];
+    int rate = batch->audio_rate;
+    Chip8_Audio audio[CHIP8_LANES];
+    uint64_t audio_hash[CHIP8_LANES] = {0};
+
+    for (int l = 0; l < count; l++) {
+        ids[l] = first + l;
+        machines[l] = &batch->machines[first + l];
+        if (rate) {
+            chip8_audio_init(&audio[l], rate);
+            audio_hash[l] = 0xcbf29ce484222325ull;
+        }
+    }
+
+    uint32_t frame;
+    for (frame = 0; frame < run->frames && count > 0; frame++) {
+        for (int l = 0; l < count; l++) {
+            if (run->input != NULL) {
+                chip8_set_keyboard(machines[l], run->input(ids[l], frame, run->user));
+            }
+            before[l] = machines[l]->cycles;
+        }
+
+        chip8_lanes_run(&lanes, machines, count, status);
+
+        // the machines that faulted are done, the others move to the next frame
+        int alive = 0;
+        for (int l = 0; l < count; l++) {
+            Chip8 *chip8 = machines[l];
+            size_t id = ids[l];
+            instructions[l] += before[l] - chip8->cycles;
+            if (status[l] != CHIP8_OK) {
+                batch->results[id] = (Chip8_Result) {
+                    .status = status[l],
+                    .pc = chip8->pc,
+                    .frames = frame,
+                    .instructions = instructions[l],
+                    .frame_hash = chip8_frame_hash(chip8),
+                    .audio_hash = audio_hash[l],
+                };
+                continue;
+            }
+
+            if (rate) audio_hash[l] = hash_audio(&audio[l], chip8, rate, audio_hash[l]);
+            chip8_tick_frame(chip8);
+            machines[alive] = chip8;
+            ids[alive] = id;
+            instructions[alive] = instructions[l];
+            if (alive != l) audio[alive] = audio[l];
+            audio_hash[alive] = audio_hash[l];
+            alive++;
+        }
+
+        count = alive;
+    }
+
+    worker->vector_ops += lanes.vector_ops;
+    worker->scalar_ops += lanes.scalar_ops;
+
+    for (int l = 0; l < count; l++) {
+        batch->results[ids[l]] = (Chip8_Result) {
+            .status = CHIP8_OK,
+            .pc = machines[l]->pc,
+            .frames = frame,
+            .instructions = instructions[l],
+            .frame_hash = chip8_frame_hash(machines[l]),
+            .audio_hash = audio_hash[l],
+        };
+    }
+}
+
+static void run_unit(Batch_Run *run, Worker *worker, size_t unit) {
+    if (run->batch->lockstep) run_group(run, worker, unit);
+    else run_instance(run, unit);
+}
+
+static bool take_own(Worker *worker, uint32_t *unit) {
+    uint64_t r = atomic_load(&worker->range);
+    while (RANGE_LO(r) < RANGE_HI(r)) {
+        if (atomic_compare_exchange_weak(&worker->range, &r, RANGE(RANGE_LO(r) + 1, RANGE_HI(r)))) {
+            *unit = RANGE_LO(r);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+// Moves the upper half of victim's range to worker and returns its first unit
+static bool steal(Worker *worker, Worker *victim, uint32_t *unit) {
+    uint64_t r = atomic_load(&victim->range);
+    while (RANGE_LO(r) < RANGE_HI(r)) {
+        uint32_t lo = RANGE_LO(r), hi = RANGE_HI(r);
+        uint32_t mid = lo + (hi - lo)/2;
+        if (atomic_compare_exchange_weak(&victim->range, &r, RANGE(lo, mid))) {
+            // our range is empty, so no thief is going to CAS it under us
+            atomic_store(&worker->range, RANGE(mid + 1, hi));
+            worker->steals += hi - mid;
+            *unit = mid;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static void *worker_main(void *data) {
+    Worker_Arg *arg = data;
+    Batch_Run *run = arg->run;
+    Worker *self = &run->workers[arg->id];
+
+    for (;;) {
+        uint32_t unit;
+        if (take_own(self, &unit)) {
+            run_unit(run, self, unit);
+            continue;
+        }
+
+        bool stolen = false;
+        for (int k = 1; k < run->worker_cnt && !stolen; k++) {
+            Worker *victim = &run->workers[(arg->id + k) % run->worker_cnt];
+            stolen = steal(self, victim, &unit);
+        }
+
+        if (!stolen) break;
+        run_unit(run, self, unit);
+    }
+
+    return NULL;
+}
+
+void chip8_batch_run(Chip8_Batch *batch, int threads, uint32_t frames,
+                     Chip8_Batch_Input input, void *user) {
+    if (threads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        threads = cpus > 0 ? cpus : 1;
+    }
+    size_t units = batch->lockstep ? (batch->count + CHIP8_LANES - 1)/CHIP8_LANES : batch->count;
+    if ((size_t) threads > units) threads = units;
+
+    Worker *workers = aligned_alloc(64, threads*sizeof(Worker));
+    pthread_t *tids = malloc(threads*sizeof(pthread_t));
+    Worker_Arg *args = malloc(threads*sizeof(Worker_Arg));
+
+    Batch_Run run = {
+        .batch = batch,
+        .workers = workers,
+        .worker_cnt = threads,
+        .frames = frames,
+        .input = input,
+        .user = user,
+    };
+
+    batch->steals = 0;
+    batch->vector_ops = 0;
+    batch->scalar_ops = 0;
+    if (workers == NULL || tids == NULL || args == NULL) {
+        // still produce the results, just without the threads
+        Worker alone = {0};
+        for (size_t u = 0; u < units; u++) run_unit(&run, &alone, u);
+        batch->vector_ops = alone.vector_ops;
+        batch->scalar_ops = alone.scalar_ops;
+        free(workers);
+        free(tids);
+        free(args);
+        return;
+    }
+
+    for (int w = 0; w < threads; w++) {
+        uint32_t lo = units*w/threads;
+        uint32_t hi = units*(w + 1)/threads;
+        atomic_init(&workers[w].range, RANGE(lo, hi));
+        workers[w].steals = 0;
+        workers[w].vector_ops = 0;
+        workers[w].scalar_ops = 0;
+    }
+
+    int started = 1;
+    for (int w = 1; w < threads; w++) {
+        args[w] = (Worker_Arg) { .run = &run, .id = w };
+        if (pthread_create(&tids[w], NULL, worker_main, &args[w]) != 0) break;
+        started++;
+    }
+
+    // the calling thread is worker 0; workers that failed to start get their
+    // ranges stolen by the others
+    Worker_Arg self = { .run = &run, .id = 0 };
+    worker_main(&self);
+
+    for (int w = 1; w < started; w++) {
+        pthread_join(tids[w], NULL);
+    }
+
+    for (int w = 0; w < threads; w++) {
+        batch->steals += workers[w].steals;
+        batch->vector_ops += workers[w].vector_ops;
+        batch->scalar_ops += workers[w].scalar_ops;
+    }
+
+    free(workers);
+    free(tids);
+    free(args);
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
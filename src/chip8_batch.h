@@ -0,0 +1,63 @@
+#ifndef CHIP8_BATCH_H_
+#define CHIP8_BATCH_H_
+
+#include "chip8.h"
+#include "chip8_audio.h"
+
+#define CHIP8_BATCH_MAX_AUDIO_RATE 96000
+
+// Runs many independent machines across all cores. Each worker owns a contiguous
+// range of instances and steals half of another worker's range when its own runs out,
+// so ROMs that finish early (or fault) don't leave cores idle.
+//
+//     Chip8_Batch batch;
+//     chip8_batch_init(&batch, 1000);
+//     for (size_t i = 0; i < batch.count; i++) chip8_load_rom(&batch.machines[i], rom);
+//     chip8_batch_run(&batch, 0, 600, NULL, NULL);
+//     ... batch.results[i] ...
+//     chip8_batch_free(&batch);
+
+typedef struct {
+    Chip8_Status status;
+    // pc of the faulting instruction when status is not CHIP8_OK
+    uint16_t pc;
+    uint32_t frames;
+    uint64_t instructions;
+    uint64_t frame_hash;
+    // hash of every sample of the sound, only when Chip8_Batch.audio_rate is set
+    uint64_t audio_hash;
+} Chip8_Result;
+
+// Returns the keyboard of instance for the given frame. Called from the worker threads,
+// so it must not touch shared state without its own locking
+typedef uint16_t (*Chip8_Batch_Input)(size_t instance, uint32_t frame, void *user);
+
+typedef struct {
+    size_t count;
+    Chip8 *machines;
+    // one per machine, filled by chip8_batch_run
+    Chip8_Result *results;
+    // run CHIP8_LANES neighbouring machines at a time with chip8_lanes_run, for
+    // batches where many instances share a rom
+    bool lockstep;
+    // when not 0, the sound of every machine is rendered at this sample rate (up to
+    // CHIP8_BATCH_MAX_AUDIO_RATE) and hashed into its result
+    int audio_rate;
+    // units (instances, or groups in lockstep mode) taken from another worker in the last run
+    uint64_t steals;
+    // lockstep mode: instructions run for a whole group, and lane by lane
+    uint64_t vector_ops, scalar_ops;
+} Chip8_Batch;
+
+// Allocates and chip8_init's count machines. The caller loads the roms (and seeds,
+// enables the JIT, ...) afterwards. Returns false when out of memory
+bool chip8_batch_init(Chip8_Batch *batch, size_t count);
+void chip8_batch_free(Chip8_Batch *batch);
+
+// Runs every machine for frames frames of ipf instructions, or until it faults, on
+// threads workers (0 means one per online cpu). input may be NULL. Results only depend
+// on the machines and the input, never on the number of threads
+void chip8_batch_run(Chip8_Batch *batch, int threads, uint32_t frames,
+                     Chip8_Batch_Input input, void *user);
+
+#endif // CHIP8_BATCH_H_
@@ -0,0 +1,118 @@
+#include <time.h>
+#include <errno.h>
+#include <math.h>
+
+#include "chip8_clock.h"
+
+#define NS_PER_SEC 1000000000ll
+
+int64_t chip8_clock_deadline(const Chip8_Clock *clock, uint64_t index) {
+    return clock->start + (int64_t) (index*NS_PER_SEC/clock->hz);
+}
+
+int64_t chip8_clock_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*NS_PER_SEC + ts.tv_nsec;
+}
+
+void chip8_clock_init(Chip8_Clock *clock, int hz, int max_catch_up) {
+    int64_t now = chip8_clock_now();
+    *clock = (Chip8_Clock) {
+        .hz = hz,
+        .max_catch_up = max_catch_up > 0 ? max_catch_up : 1,
+        .start = now,
+        .next = now,
+        .last_due = now,
+    };
+}
+
+int chip8_clock_due(Chip8_Clock *clock) {
+    int64_t now = chip8_clock_now();
+
+    if (clock->index > 0) {
+        int64_t frame = now - clock->last_due;
+        clock->frames++;
+        clock->frame_sum += frame;
+        clock->frame_sum_sq += (double) frame*frame;
+        if (frame > clock->frame_max) clock->frame_max = frame;
+    }
+    clock->last_due = now;
+
+    if (now < clock->next) return 0;
+
+    // the deadlines stay on the grid from the start, the remainder carries over
+    uint64_t due = (uint64_t) (now - clock->start)*clock->hz/NS_PER_SEC + 1 - clock->index;
+    while (chip8_clock_deadline(clock, clock->index + due) <= now) due++;
+    int ticks = due < (uint64_t) clock->max_catch_up ? (int) due : clock->max_catch_up;
+    if (ticks > 1) clock->catch_ups++;
+    // the oldest ones are dropped, what runs is the newest
+    clock->dropped += due - ticks;
+    clock->index += due - ticks;
+
+    for (int i = 0; i < ticks; i++) {
+        int64_t late = now - chip8_clock_deadline(clock, clock->index);
+        clock->tick_late_sum += late;
+        if (late > clock->tick_late_max) clock->tick_late_max = late;
+        clock->index++;
+    }
+    clock->next = chip8_clock_deadline(clock, clock->index);
+
+    clock->ticks += ticks;
+    return ticks;
+}
+
+void chip8_clock_sleep(Chip8_Clock *clock) {
+    struct timespec deadline = {
+        .tv_sec = clock->next/NS_PER_SEC,
+        .tv_nsec = clock->next%NS_PER_SEC,
+    };
+
+    // absolute, so a signal or a late start does not push the deadline
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR);
+
+    int64_t late = chip8_clock_now() - clock->next;
+    if (late < 0) late = 0;
+    clock->wakes++;
+    clock->wake_late_sum += late;
+    if (late > clock->wake_late_max) clock->wake_late_max = late;
+}
+
+Chip8_Clock_Stats chip8_clock_stats(const Chip8_Clock *clock) {
+    // the first tick is due at the start, so the ticks cover one period more
+    double seconds = (double) (clock->last_due - clock->start)/NS_PER_SEC + 1.0/clock->hz;
+    Chip8_Clock_Stats stats = {
+        .seconds = seconds,
+        .tick_hz = clock->ticks/seconds,
+        .dropped = clock->dropped,
+        .catch_ups = clock->catch_ups,
+        .tick_late_max_ms = clock->tick_late_max*1e-6,
+        .frame_max_ms = clock->frame_max*1e-6,
+        .wake_max_us = clock->wake_late_max*1e-3,
+    };
+
+    if (clock->ticks) stats.tick_late_mean_ms = clock->tick_late_sum/clock->ticks*1e-6;
+    if (clock->wakes) stats.wake_mean_us = clock->wake_late_sum/clock->wakes*1e-3;
+    if (clock->frames) {
+        double mean = clock->frame_sum/clock->frames;
+        double variance = clock->frame_sum_sq/clock->frames - mean*mean;
+        stats.frame_mean_ms = mean*1e-6;
+        stats.frame_jitter_ms = sqrt(variance > 0 ? variance : 0)*1e-6;
+    }
+
+    return stats;
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
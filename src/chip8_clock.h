@@ -0,0 +1,80 @@
+#ifndef CHIP8_CLOCK_H_
+#define CHIP8_CLOCK_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Fixed-timestep scheduler on the monotonic clock. The deadlines are exact multiples
+// of the period from the start, so nothing is lost between ticks and the timers run at
+// 60Hz however fast or unevenly the host loop goes. After a stall the missed ticks are
+// run back to back, up to a cap, the rest are dropped.
+//
+//     Chip8_Clock clock;
+//     chip8_clock_init(&clock, 60, 4);
+//     while (...) {
+//         int ticks = chip8_clock_due(&clock);
+//         ... run `ticks` frames, draw
+//         chip8_clock_sleep(&clock);
+//     }
+//
+// The stats are gathered on the way, chip8_clock_stats sums them up.
+
+typedef struct {
+    int hz;
+    int max_catch_up;
+    // monotonic ns of the start and of the next deadline. Deadline n is at
+    // start + n*1e9/hz, rounded on its own, so the rounding does not add up
+    int64_t start;
+    uint64_t index;
+    int64_t next;
+
+    // ticks given out and dropped, calls to chip8_clock_due that caught up, and how
+    // late the ticks were given out after their deadline
+    uint64_t ticks;
+    uint64_t dropped;
+    uint64_t catch_ups;
+    double tick_late_sum;
+    int64_t tick_late_max;
+    // time between the calls to chip8_clock_due, the host frames
+    int64_t last_due;
+    uint64_t frames;
+    double frame_sum;
+    double frame_sum_sq;
+    int64_t frame_max;
+    // how late chip8_clock_sleep woke up after its deadline
+    uint64_t wakes;
+    double wake_late_sum;
+    int64_t wake_late_max;
+} Chip8_Clock;
+
+typedef struct {
+    double seconds;
+    // ticks per second of wall time (60 when none were dropped), and how late they
+    // came after their deadline, in ms
+    double tick_hz;
+    double tick_late_mean_ms;
+    double tick_late_max_ms;
+    uint64_t dropped;
+    uint64_t catch_ups;
+    // host frame time: mean, standard deviation (the jitter) and worst, in ms
+    double frame_mean_ms;
+    double frame_jitter_ms;
+    double frame_max_ms;
+    // wake up lateness, in us
+    double wake_mean_us;
+    double wake_max_us;
+} Chip8_Clock_Stats;
+
+int64_t chip8_clock_now(void);
+// The first tick is due right away
+void chip8_clock_init(Chip8_Clock *clock, int hz, int max_catch_up);
+// Ticks due since the last call, 0 to max_catch_up
+int chip8_clock_due(Chip8_Clock *clock);
+// Monotonic ns of deadline `index`: the frames given out by the last chip8_clock_due
+// are index - ticks to index - 1, and frame n spans deadline n to n + 1
+int64_t chip8_clock_deadline(const Chip8_Clock *clock, uint64_t index);
+// Sleeps until the next deadline, returns at once if it is gone
+void chip8_clock_sleep(Chip8_Clock *clock);
+Chip8_Clock_Stats chip8_clock_stats(const Chip8_Clock *clock);
+
+#endif // CHIP8_CLOCK_H_
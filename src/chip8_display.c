@@ -0,0 +1,62 @@
+#include <string.h>
+
+#include "chip8_display.h"
+
+void chip8_display_init(Chip8_Display *display) {
+    memset(display, 0, sizeof(*display));
+    display->back = 0;
+    display->middle = 1;
+    display->front = 2;
+}
+
+Chip8_Frame *chip8_display_back(Chip8_Display *display) {
+    return &display->slots[display->back];
+}
+
+void chip8_display_publish(Chip8_Display *display, int64_t now) {
+    display->slots[display->back].published_at = now;
+    // release: the screen is written before the reader can take the slot
+    int old = atomic_exchange_explicit(&display->middle, display->back | CHIP8_DISPLAY_FRESH, memory_order_acq_rel);
+    display->back = old & ~CHIP8_DISPLAY_FRESH;
+    atomic_fetch_add_explicit(&display->published, 1, memory_order_relaxed);
+}
+
+const Chip8_Frame *chip8_display_take(Chip8_Display *display) {
+    if (!(atomic_load_explicit(&display->middle, memory_order_relaxed) & CHIP8_DISPLAY_FRESH)) return NULL;
+
+    // only the reader clears FRESH, so it is still set
+    int old = atomic_exchange_explicit(&display->middle, display->front, memory_order_acq_rel);
+    display->front = old & ~CHIP8_DISPLAY_FRESH;
+    atomic_fetch_add_explicit(&display->taken, 1, memory_order_relaxed);
+    return &display->slots[display->front];
+}
+
+void chip8_display_presented(Chip8_Display *display, const Chip8_Frame *frame, int64_t now) {
+    int64_t latency = now - frame->published_at;
+    display->presented++;
+    display->latency_sum += latency;
+    if (latency > display->latency_max) display->latency_max = latency;
+    if (frame->input_at) atomic_store_explicit(&display->input_shown, frame->input_at, memory_order_relaxed);
+}
+
+uint64_t chip8_display_dropped(const Chip8_Display *display) {
+    uint64_t published = atomic_load_explicit(&display->published, memory_order_relaxed);
+    uint64_t taken = atomic_load_explicit(&display->taken, memory_order_relaxed);
+    // the last one may still be waiting in the middle
+    bool fresh = atomic_load_explicit(&display->middle, memory_order_relaxed) & CHIP8_DISPLAY_FRESH;
+    return published - taken - fresh;
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
@@ -0,0 +1,61 @@
+#ifndef CHIP8_DISPLAY_H_
+#define CHIP8_DISPLAY_H_
+
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+// Triple buffer of screens from one writer (the emulation thread) to one reader (the
+// thread that presents them). The writer fills the back slot and swaps it with the
+// middle one, the reader swaps the middle one with its front slot when there is a new
+// screen in it. Neither ever waits for the other: the writer overwrites a screen the
+// reader did not get to (a dropped frame), the reader keeps showing the one it has.
+//
+//     emulation                                      display
+//     Chip8_Frame *frame = chip8_display_back(&d);   const Chip8_Frame *frame = chip8_display_take(&d);
+//     ... copy the screen into frame                 if (frame) ... upload and present it
+//     chip8_display_publish(&d, now);                chip8_display_presented(&d, frame, now);
+//
+// Times are monotonic ns, see chip8_clock_now.
+
+typedef struct {
+    Chip8_Plane planes[FRAME_PLANES];
+    bool hires;
+    // emulated frame it is the screen of, and when it was published
+    uint64_t frame;
+    int64_t published_at;
+    // poll time of the key change it is the first screen after, 0 when none
+    int64_t input_at;
+} Chip8_Frame;
+
+typedef struct {
+    Chip8_Frame slots[3];
+    // slot of the writer and slot of the reader
+    int back;
+    int front;
+    // the slot in between, with CHIP8_DISPLAY_FRESH set while it holds a screen the
+    // reader did not take
+    _Alignas(64) _Atomic int middle;
+    // written by the writer
+    _Alignas(64) _Atomic uint64_t published;
+    // written by the reader: screens taken, and input_at of the last one presented
+    _Alignas(64) _Atomic uint64_t taken;
+    _Atomic int64_t input_shown;
+    // reader only: screens presented and the time from publish to present
+    uint64_t presented;
+    double latency_sum;
+    int64_t latency_max;
+} Chip8_Display;
+
+#define CHIP8_DISPLAY_FRESH 4
+
+void chip8_display_init(Chip8_Display *display);
+Chip8_Frame *chip8_display_back(Chip8_Display *display);
+void chip8_display_publish(Chip8_Display *display, int64_t now);
+// The newest screen published since the last call, NULL when there is none
+const Chip8_Frame *chip8_display_take(Chip8_Display *display);
+void chip8_display_presented(Chip8_Display *display, const Chip8_Frame *frame, int64_t now);
+// Screens published that the reader never took
+uint64_t chip8_display_dropped(const Chip8_Display *display);
+
+#endif // CHIP8_DISPLAY_H_
@@ -0,0 +1,320 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "chip8_input.h"
+
+#define MAGIC "C8IN"
+#define VERSION 2
+// magic, version, rom_hash, rng, ipf, quirks, cycles, frames, frame_hash, sequence_hash, size
+#define HEADER_SIZE (4 + 1 + 8 + 4 + 4 + 1 + 8 + 4 + 8 + 8 + 8)
+// a varint of a 64-bit delta and a keyboard
+#define MAX_EVENT (10 + 2)
+// the replay runs at most this many instructions per call, so cycles never wraps
+#define MAX_RUN (1 << 24)
+#define KEY_QUEUE_MASK (CHIP8_KEY_QUEUE - 1)
+
+static uint64_t memory_hash(const Chip8 *chip8) {
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (size_t i = 0; i < MEMORY_SIZE; i++) {
+        hash ^= chip8->memory[i];
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+static uint64_t sequence_next(uint64_t hash, const Chip8 *chip8) {
+    return (hash ^ chip8_frame_hash(chip8))*0x100000001b3ull;
+}
+
+void chip8_input_start(Chip8_Input_Log *log, const Chip8 *chip8) {
+    *log = (Chip8_Input_Log) {
+        .summary = {
+            .rom_hash = memory_hash(chip8),
+            .rng = chip8->rng,
+            .ipf = chip8->ipf,
+            .quirks = chip8->quirks,
+            .frame_hash = chip8_frame_hash(chip8),
+        },
+        .keyboard = chip8->keyboard,
+    };
+}
+
+static bool emit(Chip8_Input_Log *log, uint64_t cycle, bool keyboard) {
+    if (log->size + MAX_EVENT > log->capacity) {
+        size_t capacity = log->capacity ? log->capacity*2 : 4096;
+        uint8_t *events = realloc(log->events, capacity);
+        if (events == NULL) return false;
+        log->events = events;
+        log->capacity = capacity;
+    }
+
+    uint64_t v = (cycle - log->last_cycle) << 1 | keyboard;
+    do {
+        log->events[log->size++] = (v & 0x7F) | (v > 0x7F ? 0x80 : 0);
+        v >>= 7;
+    } while (v);
+
+    if (keyboard) {
+        log->events[log->size++] = log->keyboard & 0xFF;
+        log->events[log->size++] = log->keyboard >> 8;
+    }
+
+    log->last_cycle = cycle;
+    return true;
+}
+
+bool chip8_input_keyboard(Chip8_Input_Log *log, uint64_t cycle, uint16_t keyboard) {
+    if (keyboard == log->keyboard) return true;
+
+    uint16_t previous = log->keyboard;
+    log->keyboard = keyboard;
+    if (!emit(log, cycle, true)) {
+        log->keyboard = previous;
+        return false;
+    }
+
+    return true;
+}
+
+bool chip8_input_tick(Chip8_Input_Log *log, uint64_t cycle, const Chip8 *chip8) {
+    if (!emit(log, cycle, false)) return false;
+
+    log->summary.frames++;
+    log->summary.sequence_hash = sequence_next(log->summary.sequence_hash, chip8);
+    return true;
+}
+
+void chip8_input_finish(Chip8_Input_Log *log, uint64_t cycle, const Chip8 *chip8) {
+    log->summary.cycles = cycle;
+    log->summary.frame_hash = chip8_frame_hash(chip8);
+}
+
+void chip8_input_free(Chip8_Input_Log *log) {
+    free(log->events);
+    *log = (Chip8_Input_Log) {0};
+}
+
+static uint8_t *put(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) *p++ = v >> (8*i);
+    return p;
+}
+
+static const uint8_t *get(const uint8_t *p, uint64_t *v, int bytes) {
+    *v = 0;
+    for (int i = 0; i < bytes; i++) *v |= (uint64_t) *p++ << (8*i);
+    return p;
+}
+
+Chip8_Status chip8_input_save(const Chip8_Input_Log *log, const char *path) {
+    const Chip8_Input_Summary *s = &log->summary;
+    uint8_t header[HEADER_SIZE];
+    uint8_t *p = header;
+    memcpy(p, MAGIC, 4);
+    p += 4;
+    *p++ = VERSION;
+    p = put(p, s->rom_hash, 8);
+    p = put(p, s->rng, 4);
+    p = put(p, s->ipf, 4);
+    *p++ = s->quirks;
+    p = put(p, s->cycles, 8);
+    p = put(p, s->frames, 4);
+    p = put(p, s->frame_hash, 8);
+    p = put(p, s->sequence_hash, 8);
+    put(p, log->size, 8);
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        return CHIP8_ERR_INPUT_OPEN;
+    }
+
+    Chip8_Status status = CHIP8_OK;
+    if (fwrite(header, 1, sizeof(header), file) != sizeof(header) ||
+        fwrite(log->events, 1, log->size, file) != log->size) {
+        fprintf(stderr, "ERROR: could not write input log %s: %s\n", path, strerror(errno));
+        status = CHIP8_ERR_INPUT_OPEN;
+    }
+
+    if (fclose(file) != 0 && status == CHIP8_OK) {
+        fprintf(stderr, "ERROR: could not write input log %s: %s\n", path, strerror(errno));
+        status = CHIP8_ERR_INPUT_OPEN;
+    }
+
+    return status;
+}
+
+Chip8_Status chip8_input_load(Chip8_Input_Log *log, const char *path) {
+    *log = (Chip8_Input_Log) {0};
+    Chip8_Status status = CHIP8_OK;
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        status = CHIP8_ERR_INPUT_OPEN;
+        goto ERROR;
+    }
+
+    uint8_t header[HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, MAGIC, 4) != 0 || header[4] != VERSION) {
+        fprintf(stderr, "ERROR: %s is not an input log\n", path);
+        status = CHIP8_ERR_INPUT_FORMAT;
+        goto ERROR;
+    }
+
+    Chip8_Input_Summary *s = &log->summary;
+    const uint8_t *p = header + 5;
+    uint64_t v, size;
+    p = get(p, &s->rom_hash, 8);
+    p = get(p, &v, 4), s->rng = v;
+    p = get(p, &v, 4), s->ipf = (int32_t) v;
+    s->quirks = *p++;
+    p = get(p, &s->cycles, 8);
+    p = get(p, &v, 4), s->frames = v;
+    p = get(p, &s->frame_hash, 8);
+    p = get(p, &s->sequence_hash, 8);
+    get(p, &size, 8);
+    if (s->quirks >= __CHIP8_QUIRKS_CNT__) {
+        fprintf(stderr, "ERROR: %s has an unknown quirk profile %d\n", path, s->quirks);
+        status = CHIP8_ERR_INPUT_FORMAT;
+        goto ERROR;
+    }
+
+    log->events = malloc(size ? size : 1);
+    if (log->events == NULL || fread(log->events, 1, size, file) != size) {
+        fprintf(stderr, "ERROR: could not read input log %s\n", path);
+        status = CHIP8_ERR_INPUT_FORMAT;
+        goto ERROR;
+    }
+    log->size = size;
+    log->capacity = size;
+
+ERROR:
+    if (file) {
+        fclose(file);
+    }
+
+    if (status != CHIP8_OK) {
+        chip8_input_free(log);
+    }
+
+    return status;
+}
+
+// Runs chip8 until *cycle reaches target. Stops short when an Fx0A waits for a key
+// the log never gives or a DRW for a tick, which only happens when the replay went
+// another way
+static Chip8_Status run_until(Chip8 *chip8, uint64_t *cycle, uint64_t target) {
+    while (*cycle < target) {
+        uint64_t left = target - *cycle;
+        int n = left < MAX_RUN ? (int) left : MAX_RUN;
+        int before = chip8->cycles;
+        Chip8_Status status = chip8_run_cycles(chip8, n);
+        int done = before - chip8->cycles;
+        *cycle += done;
+        if (status != CHIP8_OK) return status;
+        if (done < n) break;
+    }
+
+    return CHIP8_OK;
+}
+
+Chip8_Status chip8_input_replay(const Chip8_Input_Log *log, Chip8 *chip8, Chip8_Input_Summary *got) {
+    chip8->rng = log->summary.rng;
+    chip8->ipf = log->summary.ipf;
+    chip8->cycles = chip8->ipf;
+    chip8_set_quirks(chip8, log->summary.quirks);
+    *got = (Chip8_Input_Summary) {
+        .rom_hash = memory_hash(chip8),
+        .rng = chip8->rng,
+        .ipf = chip8->ipf,
+        .quirks = chip8->quirks,
+    };
+
+    Chip8_Status status = CHIP8_OK;
+    uint64_t cycle = 0, at = 0;
+    size_t i = 0;
+    while (i < log->size) {
+        uint64_t v = 0;
+        int shift = 0;
+        uint8_t byte;
+        do {
+            byte = log->events[i++];
+            v |= (uint64_t) (byte & 0x7F) << shift;
+            shift += 7;
+        } while ((byte & 0x80) && i < log->size && shift < 64);
+
+        at += v >> 1;
+        status = run_until(chip8, &cycle, at);
+        if (status != CHIP8_OK) break;
+
+        if (v & 1) {
+            if (i + 2 > log->size) break;
+            chip8_set_keyboard(chip8, log->events[i] | log->events[i + 1] << 8);
+            i += 2;
+        } else {
+            chip8_tick_frame(chip8);
+            got->frames++;
+            got->sequence_hash = sequence_next(got->sequence_hash, chip8);
+        }
+    }
+
+    if (status == CHIP8_OK) status = run_until(chip8, &cycle, log->summary.cycles);
+
+    got->cycles = cycle;
+    got->frame_hash = chip8_frame_hash(chip8);
+    return status;
+}
+
+bool chip8_input_same(const Chip8_Input_Summary *a, const Chip8_Input_Summary *b) {
+    return a->rom_hash == b->rom_hash && a->rng == b->rng && a->ipf == b->ipf && a->quirks == b->quirks &&
+           a->cycles == b->cycles && a->frames == b->frames &&
+           a->frame_hash == b->frame_hash && a->sequence_hash == b->sequence_hash;
+}
+
+void chip8_keys_init(Chip8_Key_Queue *queue) {
+    memset(queue, 0, sizeof(*queue));
+}
+
+bool chip8_keys_push(Chip8_Key_Queue *queue, int64_t at, uint16_t keyboard) {
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_acquire);
+    if (tail - head == CHIP8_KEY_QUEUE) {
+        atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+        return false;
+    }
+
+    queue->events[tail & KEY_QUEUE_MASK] = (Chip8_Key_Event) { .at = at, .keyboard = keyboard };
+    atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+    return true;
+}
+
+const Chip8_Key_Event *chip8_keys_peek(Chip8_Key_Queue *queue, int64_t before) {
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    uint64_t tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+    if (head == tail) return NULL;
+
+    const Chip8_Key_Event *event = &queue->events[head & KEY_QUEUE_MASK];
+    return event->at < before ? event : NULL;
+}
+
+void chip8_keys_pop(Chip8_Key_Queue *queue) {
+    uint64_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+    atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
@@ -0,0 +1,106 @@
+#ifndef CHIP8_INPUT_H_
+#define CHIP8_INPUT_H_
+
+#include <stdatomic.h>
+
+#include "chip8.h"
+
+// Input log: everything from outside that a session fed to the machine, so it can be
+// replayed bit for bit. With the rng state it started from, the only inputs left are
+// the keyboard and the 60Hz ticks, both logged at the instruction (cycle) they happened
+// at. Replaying runs exactly the same instructions between them, as fast as the host
+// goes, and must end with the same screens.
+//
+//     Chip8_Input_Log log;
+//     chip8_input_start(&log, &chip8);
+//     ... chip8_input_keyboard(&log, cycle, keys) when the keys change
+//     ... chip8_input_tick(&log, cycle, &chip8) right after every chip8_tick_frame
+//     chip8_input_finish(&log, cycle, &chip8);
+//     chip8_input_save(&log, "session.c8in");
+//
+// The file is a header followed by the events. An event is a LEB128 varint of
+// (cycles since the previous event << 1 | is_keyboard), and a keyboard event carries the
+// new keyboard as 2 bytes. All numbers are little-endian.
+
+typedef struct {
+    // machine the log starts from
+    uint64_t rom_hash;
+    uint32_t rng;
+    int ipf;
+    // Chip8_Quirks
+    uint8_t quirks;
+    // where it ends
+    uint64_t cycles;
+    uint32_t frames;
+    uint64_t frame_hash;
+    // hash of the screen at every tick, in order
+    uint64_t sequence_hash;
+} Chip8_Input_Summary;
+
+typedef struct {
+    Chip8_Input_Summary summary;
+    uint8_t *events;
+    size_t size;
+    size_t capacity;
+
+    // while recording: cycle of the last event and the keyboard as it was left
+    uint64_t last_cycle;
+    uint16_t keyboard;
+} Chip8_Input_Log;
+
+// Starts a recording of chip8, which must be freshly loaded and seeded
+void chip8_input_start(Chip8_Input_Log *log, const Chip8 *chip8);
+// cycle is the count of instructions executed since the start. Both return false when
+// out of memory, the log is left as it was
+bool chip8_input_keyboard(Chip8_Input_Log *log, uint64_t cycle, uint16_t keyboard);
+bool chip8_input_tick(Chip8_Input_Log *log, uint64_t cycle, const Chip8 *chip8);
+void chip8_input_finish(Chip8_Input_Log *log, uint64_t cycle, const Chip8 *chip8);
+void chip8_input_free(Chip8_Input_Log *log);
+
+Chip8_Status chip8_input_save(const Chip8_Input_Log *log, const char *path);
+Chip8_Status chip8_input_load(Chip8_Input_Log *log, const char *path);
+
+// Replays log on chip8, which must have the rom loaded (and the JIT enabled, if
+// wanted): the rng, ipf and quirk profile are set from the log. Fills got with what the replay did,
+// to be compared with log->summary. Stops on the first fault
+Chip8_Status chip8_input_replay(const Chip8_Input_Log *log, Chip8 *chip8, Chip8_Input_Summary *got);
+bool chip8_input_same(const Chip8_Input_Summary *a, const Chip8_Input_Summary *b);
+
+// Key queue: the keyboard changes as they are polled, stamped with the monotonic time
+// (ns) they were seen at, from one producer (the input polling) to one consumer (the
+// emulation). The emulation applies each at the cycle its time falls on, so the keys
+// land where they were pressed within the frame, and the frames caught up after a
+// stall run with the keys as they were then.
+//
+//     input                                          emulation, for the frame [start, end)
+//     chip8_keys_push(&keys, now, keyboard);         while ((event = chip8_keys_peek(&keys, end))) {
+//                                                        ... run up to the cycle of event->at
+//                                                        chip8_set_keyboard(&chip8, event->keyboard);
+//                                                        chip8_keys_pop(&keys);
+//                                                    }
+
+typedef struct {
+    int64_t at;
+    uint16_t keyboard;
+} Chip8_Key_Event;
+
+// a power of two
+#define CHIP8_KEY_QUEUE 64
+
+typedef struct {
+    Chip8_Key_Event events[CHIP8_KEY_QUEUE];
+    // written by the producer: events pushed, and dropped because the queue was full
+    _Alignas(64) _Atomic uint64_t tail;
+    _Atomic uint64_t dropped;
+    // written by the consumer: events applied
+    _Alignas(64) _Atomic uint64_t head;
+} Chip8_Key_Queue;
+
+void chip8_keys_init(Chip8_Key_Queue *queue);
+// Returns false when the queue is full, the event is dropped
+bool chip8_keys_push(Chip8_Key_Queue *queue, int64_t at, uint16_t keyboard);
+// The oldest event from before `before`, NULL when there is none
+const Chip8_Key_Event *chip8_keys_peek(Chip8_Key_Queue *queue, int64_t before);
+void chip8_keys_pop(Chip8_Key_Queue *queue);
+
+#endif // CHIP8_INPUT_H_
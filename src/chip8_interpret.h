@@ -0,0 +1,535 @@
+// The interpreter, as a template: chip8.c includes this file once per quirk profile,
+// with INTERPRET set to the name of the function to define and QUIRKS to the profile.
+// QUIRK(field) reads the Chip8_Quirk_Set of the profile from a constant table, so the
+// compiler folds every quirk away and each instance only has the code of its own.
+//
+//     #define INTERPRET interpret_vip
+//     #define QUIRKS CHIP8_QUIRKS_VIP
+//     #include "chip8_interpret.h"
+//
+// With PROFILING defined as well it makes an instance that counts into chip8->profile,
+// which must be set: the counters then cost a plain increment, and the other instances
+// have none of them.
+//
+// Not a header of its own: it uses the statics of chip8.c
+
+#define QUIRK(field) (chip8_quirk_sets[QUIRKS].field)
+
+// Threaded interpreter: every handler ends by fetching the predecoded record of
+// the next pc and jumping straight to its handler (computed goto), so there is
+// no central switch and no operand extraction in the hot path
+static Chip8_Status INTERPRET(Chip8 *chip8, int n) {
+    static const void *handlers[__OP_CNT__ + 2] = {
+        [0]                  = &&decode,
+        [OP_CLS + 1]         = &&op_cls,
+        [OP_RET + 1]         = &&op_ret,
+        [OP_SCD + 1]         = &&op_scd,
+        [OP_SCU + 1]         = &&op_scu,
+        [OP_SCR + 1]         = &&op_scr,
+        [OP_SCL + 1]         = &&op_scl,
+        [OP_LOW + 1]         = &&op_low,
+        [OP_HIGH + 1]        = &&op_high,
+        [OP_SYS + 1]         = &&op_invalid,
+        [OP_CALL + 1]        = &&op_call,
+        [OP_SE_RB + 1]       = &&op_se_rb,
+        [OP_SE_RR + 1]       = &&op_se_rr,
+        [OP_OR + 1]          = &&op_or,
+        [OP_AND + 1]         = &&op_and,
+        [OP_XOR + 1]         = &&op_xor,
+        [OP_SUB + 1]         = &&op_sub,
+        [OP_SHR + 1]         = &&op_shr,
+        [OP_SUBN + 1]        = &&op_subn,
+        [OP_SHL + 1]         = &&op_shl,
+        [OP_SNE_R_B + 1]     = &&op_sne_r_b,
+        [OP_SNE_R_R + 1]     = &&op_sne_r_r,
+        [OP_JP_ADDR + 1]     = &&op_jp_addr,
+        [OP_JP_V0_ADDR + 1]  = &&op_jp_v0_addr,
+        [OP_RND + 1]         = &&op_rnd,
+        [OP_DRW + 1]         = &&op_drw,
+        [OP_SKP + 1]         = &&op_skp,
+        [OP_SKNP + 1]        = &&op_sknp,
+        [OP_ADD_R_B + 1]     = &&op_add_r_b,
+        [OP_ADD_R_R + 1]     = &&op_add_r_r,
+        [OP_ADD_I_R + 1]     = &&op_add_i_r,
+        [OP_LD_R_B + 1]      = &&op_ld_r_b,
+        [OP_LD_R_R + 1]      = &&op_ld_r_r,
+        [OP_LD_I_ADDR + 1]   = &&op_ld_i_addr,
+        [OP_LD_R_DT + 1]     = &&op_ld_r_dt,
+        [OP_LD_R_K + 1]      = &&op_ld_r_k,
+        [OP_LD_DT_R + 1]     = &&op_ld_dt_r,
+        [OP_LD_ST_R + 1]     = &&op_ld_st_r,
+        [OP_LD_FONT_R + 1]   = &&op_ld_font_r,
+        [OP_LD_BCD_R + 1]    = &&op_ld_bcd_r,
+        [OP_LD_IMEM_R + 1]   = &&op_ld_imem_r,
+        [OP_LD_R_IMEM + 1]   = &&op_ld_r_imem,
+        [OP_LD_HF_R + 1]     = &&op_ld_hf_r,
+        [OP_PLANE + 1]       = &&op_plane,
+        [OP_AUDIO + 1]       = &&op_audio,
+        [OP_PITCH + 1]       = &&op_pitch,
+        [__OP_CNT__ + 1]     = &&op_invalid,
+    };
+
+    Chip8_Status status = CHIP8_OK;
+    uint16_t pc = chip8->pc;
+    uint8_t *regs = chip8->regs;
+    int executed = 0;
+    Chip8_Decoded *d;
+    // instructions at odd addresses are not cached, they are decoded here
+    Chip8_Decoded scratch;
+
+    if (chip8->waiting_for_key || chip8->waiting_for_vblank || n <= 0) return CHIP8_OK;
+
+#if defined(DEBUG)
+    Chip8_Trace *trace = chip8->trace;
+    // executed already counts the instruction being traced
+#define TRACE() do {                                                            \
+        if (trace) {                                                            \
+            Chip8_Trace_Record *r = &trace->records[trace->count++ & trace->mask]; \
+            r->cycle = trace->cycle + executed - 1;                             \
+            r->pc = pc;                                                         \
+            r->op = chip8_op_at(chip8, pc);                                     \
+            r->regi = chip8->regi;                                              \
+            r->sp = chip8->sp;                                                  \
+            memcpy(r->regs, regs, sizeof(r->regs));                             \
+        }                                                                       \
+    } while (0)
+#else
+#define TRACE()
+#endif
+
+#if defined(PROFILING)
+    // the profiled instances only run with a profile, so counting is a plain increment.
+    // Only the ways in that are not from pc - 2 are counted, see Chip8_Profile.entries
+    Chip8_Profile *profile = chip8->profile;
+#define PROFILE_ENTER() (profile->entries[pc & (MEMORY_SIZE - 1)]++)
+#define PROFILE_COUNT(counter, v) (profile->counter += (v))
+    // the instruction writing over code did not go on to the next one yet, for the profile
+    // the run stops there while the code is dropped
+#define INVALIDATE_CODE(start, len) do {                                \
+        chip8->pc = pc + 2;                                             \
+        profile->entries[(pc + 2) & (MEMORY_SIZE - 1)]--;               \
+        chip8_invalidate_code(chip8, (start), (len));                   \
+        profile->entries[(pc + 2) & (MEMORY_SIZE - 1)]++;               \
+    } while (0)
+#else
+#define PROFILE_ENTER() ((void) 0)
+#define PROFILE_COUNT(counter, v) ((void) 0)
+#define INVALIDATE_CODE(start, len) chip8_invalidate_code(chip8, (start), (len))
+#endif
+
+#define DISPATCH() do {                                   \
+        if (executed == n) goto done;                     \
+        if (pc & ~(MEMORY_SIZE - 2)) goto slow;           \
+        d = &chip8->decoded[pc >> 1];                     \
+        executed++;                                       \
+        if (d->handler == 0) goto decode;                 \
+        TRACE();                                          \
+        goto *handlers[d->handler];                       \
+    } while (0)
+
+#define NEXT() do { pc += 2; DISPATCH(); } while (0)
+#define SKIP_IF(cond) do { pc += (cond) ? 4 : 2; PROFILE_ENTER(); DISPATCH(); } while (0)
+#define FAIL(s) do { status = (s); goto done; } while (0)
+    // how far Fx55/Fx65 move I
+#define LOAD_STORE_STEP(x) (QUIRK(load_store) == CHIP8_I_PLUS_X_PLUS_1 ? (x) + 1 : \
+                            QUIRK(load_store) == CHIP8_I_PLUS_X ? (x) : 0)
+
+    PROFILE_ENTER();
+    DISPATCH();
+
+slow:
+    if (pc > MEMORY_SIZE - 2) FAIL(CHIP8_ERR_OUT_OF_BOUNDS);
+    d = &scratch;
+    predecode(d, chip8_op_at(chip8, pc));
+    executed++;
+    TRACE();
+    goto *handlers[d->handler];
+
+decode:
+    predecode(d, chip8_op_at(chip8, pc));
+    TRACE();
+    goto *handlers[d->handler];
+
+    // 00E0 - CLS
+op_cls: {
+    if (chip8->hires || chip8->planes != 1) {
+        screen_clear(chip8);
+        NEXT();
+    }
+
+    uint64_t *frame_buffer = chip8->frame_buffer[0].lo;
+    for (int y = 0; y < FRAME_H; y++) {
+        chip8->dirty_rows |= (uint64_t) (frame_buffer[y] != 0) << y;
+    }
+
+    memset(frame_buffer, 0, sizeof(*frame_buffer)*FRAME_H);
+    NEXT();
+}
+
+    // 00EE - RET
+op_ret:
+    if (chip8->sp <= 0) FAIL(CHIP8_ERR_STACK_UNDERFLOW);
+    // not counted, the profile has it as the CALL going on to the instruction after it
+    pc = chip8->stack[--chip8->sp];
+    DISPATCH();
+
+    // 00Cn - SCD nibble
+op_scd:
+    screen_scroll_y(chip8, d->n);
+    NEXT();
+
+    // 00Dn - SCU nibble
+op_scu:
+    screen_scroll_y(chip8, -d->n);
+    NEXT();
+
+    // 00FB - SCR
+op_scr:
+    screen_scroll_x(chip8, 4);
+    NEXT();
+
+    // 00FC - SCL
+op_scl:
+    screen_scroll_x(chip8, -4);
+    NEXT();
+
+    // 00FE - LOW
+op_low:
+    screen_resolution(chip8, false);
+    NEXT();
+
+    // 00FF - HIGH
+op_high:
+    screen_resolution(chip8, true);
+    NEXT();
+
+    // 2nnn - CALL addr
+op_call:
+    if (chip8->sp >= STACK_SIZE) FAIL(CHIP8_ERR_STACK_OVERFLOW);
+    chip8->stack[chip8->sp++] = pc + 2;
+    pc = d->nnn;
+    PROFILE_ENTER();
+    DISPATCH();
+
+    // 3xkk - SE Vx, byte
+op_se_rb:
+    SKIP_IF(regs[d->x] == d->kk);
+
+    // 5xy0 - SE Vx, Vy
+op_se_rr:
+    SKIP_IF(regs[d->x] == regs[d->y]);
+
+    // 8xy1 - OR Vx, Vy
+op_or:
+    regs[d->x] |= regs[d->y];
+    if (QUIRK(vf_reset)) regs[0xF] = 0;
+    NEXT();
+
+    // 8xy2 - AND Vx, Vy
+op_and:
+    regs[d->x] &= regs[d->y];
+    if (QUIRK(vf_reset)) regs[0xF] = 0;
+    NEXT();
+
+    // 8xy3 - XOR Vx, Vy
+op_xor:
+    regs[d->x] ^= regs[d->y];
+    if (QUIRK(vf_reset)) regs[0xF] = 0;
+    NEXT();
+
+    // 8xy5 - SUB Vx, Vy
+op_sub: {
+    uint8_t vx = regs[d->x];
+    uint8_t vy = regs[d->y];
+    regs[d->x] = vx - vy;
+    regs[0xF] = vx >= vy;
+    NEXT();
+}
+
+    // 8xy6 - SHR Vx {, Vy}
+op_shr: {
+    // I found very strange that we accept VY but dont use it
+    // Its actually a quirk -> https://chip8.gulrak.net/#quirk6
+    uint8_t vy = regs[QUIRK(shift_vx) ? d->x : d->y];
+    regs[d->x] = vy >> 1;
+    regs[0xF] = vy & 1;
+    NEXT();
+}
+
+    // 8xyE - SHL Vx {, Vy}
+op_shl: {
+    // I found very strange that we accept VY but dont use it
+    // Its actually a quirk -> https://chip8.gulrak.net/#quirk6
+    uint8_t vy = regs[QUIRK(shift_vx) ? d->x : d->y];
+    regs[d->x] = vy << 1;
+    regs[0xF] = (vy >> 7) & 1;
+    NEXT();
+}
+
+    // 8xy7 - SUBN Vx, Vy
+op_subn: {
+    uint8_t vx = regs[d->x];
+    uint8_t vy = regs[d->y];
+    regs[d->x] = vy - vx;
+    regs[0xF] = vy >= vx;
+    NEXT();
+}
+
+    // 4xkk - SNE Vx, byte
+op_sne_r_b:
+    SKIP_IF(regs[d->x] != d->kk);
+
+    // 9xy0 - SNE Vx, Vy
+op_sne_r_r:
+    SKIP_IF(regs[d->x] != regs[d->y]);
+
+    // 1nnn - JP addr
+op_jp_addr:
+    pc = d->nnn;
+    PROFILE_ENTER();
+    DISPATCH();
+
+    // Bnnn - JP V0, addr (Bxnn - JP Vx, xnn with the jump quirk)
+op_jp_v0_addr:
+    pc = d->nnn + regs[QUIRK(jump_vx) ? d->x : 0];
+    PROFILE_ENTER();
+    PROFILE_COUNT(dynamic_jumps[pc & (MEMORY_SIZE - 1)], 1);
+    DISPATCH();
+
+    // Cxkk - RND Vx, byte
+op_rnd:
+    regs[d->x] = chip8_random(chip8) & d->kk;
+    NEXT();
+
+    // Dxyn - DRW Vx, Vy, nibble
+op_drw: {
+    if (chip8->hires || chip8->planes != 1 || d->n == 0) {
+        int hit = screen_draw(chip8, regs[d->x], regs[d->y], d->n, QUIRK(wrap), QUIRK(row_hits));
+        if (hit < 0) FAIL(CHIP8_ERR_OUT_OF_BOUNDS);
+        regs[0xF] = hit;
+        PROFILE_COUNT(draw_collisions, hit != 0);
+    } else {
+        // one row of the sprite at a time: the pixels that go past the right edge are
+        // shifted out of the word, the rows past the bottom are not drawn (clipping).
+        // With the wrap quirk they are rotated around to the left and to the top
+        uint64_t *frame_buffer = chip8->frame_buffer[0].lo;
+        uint8_t x = regs[d->x] % FRAME_W;
+        uint8_t y = regs[d->y] % FRAME_H;
+        uint64_t hit = 0;
+        for (uint8_t i = 0; (QUIRK(wrap) || y < FRAME_H) && i < d->n; i++, y++) {
+            uint16_t mem = chip8->regi + i;
+            if (mem >= MEMORY_SIZE) FAIL(CHIP8_ERR_OUT_OF_BOUNDS);
+
+            uint64_t bits = sprite_reverse[chip8->memory[mem]];
+            uint64_t row = QUIRK(wrap) ? bits << x | bits >> ((FRAME_W - x) & 63) : bits << x;
+            uint8_t row_y = QUIRK(wrap) ? y % FRAME_H : y;
+            hit |= frame_buffer[row_y] & row;
+            frame_buffer[row_y] ^= row;
+            chip8->dirty_rows |= (uint64_t) (row != 0) << row_y;
+        }
+
+        regs[0xF] = hit != 0;
+        PROFILE_COUNT(draw_collisions, hit != 0);
+    }
+
+    // the VIP only draws in the vertical blank, which ends the frame
+    if (QUIRK(display_wait) == CHIP8_WAIT_ALWAYS || (QUIRK(display_wait) == CHIP8_WAIT_LORES && !chip8->hires)) {
+        chip8->waiting_for_vblank = true;
+        pc += 2;
+        goto done;
+    }
+    NEXT();
+}
+
+    // Ex9E - SKP Vx
+op_skp: {
+    uint8_t key = regs[d->x];
+    if (key > 0xF) FAIL(CHIP8_ERR_INVALID_KEY);
+    SKIP_IF(chip8->keyboard & chip8_key_masks[key]);
+}
+
+    // ExA1 - SKNP Vx
+op_sknp: {
+    uint8_t key = regs[d->x];
+    if (key > 0xF) FAIL(CHIP8_ERR_INVALID_KEY);
+    SKIP_IF(!(chip8->keyboard & chip8_key_masks[key]));
+}
+
+    // 7xkk - ADD Vx, byte
+op_add_r_b:
+    regs[d->x] += d->kk;
+    NEXT();
+
+    // 8xy4 - ADD Vx, Vy
+op_add_r_r: {
+    uint16_t t = regs[d->x] + regs[d->y];
+    regs[d->x] = t;
+    regs[0xF] = t > 255;
+    NEXT();
+}
+
+    // Fx1E - ADD I, Vx
+op_add_i_r:
+    chip8->regi += regs[d->x];
+    NEXT();
+
+    // 6xkk - LD Vx, byte
+op_ld_r_b:
+    regs[d->x] = d->kk;
+    NEXT();
+
+    // 8xy0 - LD Vx, Vy
+op_ld_r_r:
+    regs[d->x] = regs[d->y];
+    NEXT();
+
+    // Annn - LD I, addr
+op_ld_i_addr:
+    chip8->regi = d->nnn;
+    NEXT();
+
+    // Fx07 - LD Vx, DT
+op_ld_r_dt: {
+    regs[d->x] = chip8->delay_timer;
+    // a loop waiting on the timer spins until the tick, the rest of the frame is skipped
+    int end = executed < n ? idle_loop_end(chip8, pc, n - executed) : -1;
+    if (end >= 0) {
+        chip8->idle = true;
+        chip8->idle_skipped += n - executed;
+        executed = n;
+        pc = end;
+        goto done;
+    }
+    NEXT();
+}
+
+    // Fx0A - LD Vx, K
+op_ld_r_k:
+    chip8->waiting_for_key = true;
+    chip8->key_reg = d->x;
+    pc += 2;
+    goto done;
+
+    // Fx15 - LD DT, Vx
+op_ld_dt_r:
+    chip8->delay_timer = regs[d->x];
+    NEXT();
+
+    // Fx18 - LD ST, Vx
+op_ld_st_r:
+    chip8->sound_timer = regs[d->x];
+    chip8->update_audio_state = true;
+    chip8->sound_cycles_left = chip8->cycles - executed;
+    NEXT();
+
+    // Fx29 - LD F, Vx
+op_ld_font_r:
+    chip8->regi = regs[d->x]*5;
+    NEXT();
+
+    // Fx33 - LD B, Vx
+op_ld_bcd_r: {
+    uint16_t start = chip8->regi;
+    if (start >= (MEMORY_SIZE - 3)) FAIL(CHIP8_ERR_OUT_OF_BOUNDS);
+
+    uint8_t v = regs[d->x];
+    chip8->memory[start + 0] = v / 100;
+    chip8->memory[start + 1] = (v / 10) % 10;
+    chip8->memory[start + 2] = (v % 10) % 10;
+    INVALIDATE_CODE(start, 3);
+    NEXT();
+}
+
+    // Fx55 - LD [I], Vx
+op_ld_imem_r: {
+    uint16_t start = chip8->regi;
+    for (uint8_t i = 0; i <= d->x; i++) {
+        uint16_t mem = start + i;
+        if (mem >= MEMORY_SIZE) {
+            INVALIDATE_CODE(start, i);
+            FAIL(CHIP8_ERR_OUT_OF_BOUNDS);
+        }
+
+        chip8->memory[mem] = regs[i];
+    }
+
+    INVALIDATE_CODE(start, d->x + 1);
+    chip8->regi += LOAD_STORE_STEP(d->x);
+    NEXT();
+}
+
+    // Fx65 - LD Vx, [I]
+op_ld_r_imem:
+    for (uint8_t i = 0; i <= d->x; i++) {
+        uint16_t mem = chip8->regi + i;
+        if (mem >= MEMORY_SIZE) FAIL(CHIP8_ERR_OUT_OF_BOUNDS);
+
+        regs[i] = chip8->memory[mem];
+    }
+
+    chip8->regi += LOAD_STORE_STEP(d->x);
+    NEXT();
+
+    // Fx30 - LD HF, Vx
+op_ld_hf_r:
+    chip8->regi = BIG_FONT_ADDR + regs[d->x]*10;
+    NEXT();
+
+    // Fn01 - PLANE n
+op_plane:
+    chip8->planes = d->x & 3;
+    NEXT();
+
+    // F002 - AUDIO: the 16 bytes at I become the audio pattern
+op_audio:
+    if (chip8->regi > MEMORY_SIZE - sizeof(chip8->audio_pattern)) FAIL(CHIP8_ERR_OUT_OF_BOUNDS);
+    memcpy(chip8->audio_pattern, &chip8->memory[chip8->regi], sizeof(chip8->audio_pattern));
+    chip8->has_pattern = true;
+    chip8->update_audio_state = true;
+    chip8->sound_cycles_left = chip8->cycles - executed;
+    NEXT();
+
+    // Fx3A - PITCH Vx
+op_pitch:
+    chip8->pitch = regs[d->x];
+    chip8->update_audio_state = true;
+    chip8->sound_cycles_left = chip8->cycles - executed;
+    NEXT();
+
+    // 0nnn - SYS addr, and words that are not instructions
+op_invalid:
+    FAIL(CHIP8_ERR_NOT_IMPLEMENTED);
+
+done:
+#if defined(PROFILING)
+    // the hits follow the entries, so what the instructions before were going on to is taken
+    // back: the next one, that did not run yet, or the one after an instruction that failed
+    // (a CALL counts as going on to it, for its RET). RET and the skips fail with their own
+    // statuses and go on to nothing
+    if (status == CHIP8_OK || pc > MEMORY_SIZE - 2) {
+        profile->entries[pc & (MEMORY_SIZE - 1)]--;
+    } else if (status != CHIP8_ERR_STACK_UNDERFLOW && status != CHIP8_ERR_INVALID_KEY) {
+        profile->entries[(pc + 2) & (MEMORY_SIZE - 1)]--;
+    }
+#endif
+    chip8->pc = pc;
+    chip8->cycles -= executed;
+#if defined(DEBUG)
+    if (trace) trace->cycle += executed;
+#endif
+    return status;
+
+#undef TRACE
+#undef PROFILE_ENTER
+#undef INVALIDATE_CODE
+#undef PROFILE_COUNT
+#undef DISPATCH
+#undef NEXT
+#undef SKIP_IF
+#undef FAIL
+#undef LOAD_STORE_STEP
+}
+
+#undef QUIRK
+#undef INTERPRET
+#undef QUIRKS
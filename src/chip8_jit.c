@@ -0,0 +1,666 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stddef.h>
+
+#include "chip8.h"
+
+// Basic-block recompiler for x86-64.
+//
+// A block is a run of straight-line instructions that ends at a jump, a call,
+// a return or a skip. It is compiled into a function
+//
+//     uint32_t block(Chip8 *chip8);   // chip8 in rdi
+//
+// that returns the pc of the next instruction, or a JIT_FAULT_* code when the
+// terminator has to fail (stack over/underflow, invalid key). The V registers
+// a block uses more than once live in host registers for the whole block and
+// are written back on exit. Anything the JIT does not translate (DRW, RND,
+// memory stores, Fx0A, Fx18, ...) ends the block and goes through the interpreter.
+//
+// No page is writable and executable at once: the code buffer is a memfd
+// mapped twice, blocks are emitted through a read/write view and run from a
+// read/execute view of the same pages.
+
+#if defined(__x86_64__) && defined(__linux__)
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#define JIT_CODE_SIZE (1 << 20)
+#define JIT_MAX_BLOCKS 2048
+#define JIT_MAX_BLOCK_LEN 32
+
+#define JIT_FAULT_STACK_OVERFLOW  0x10000
+#define JIT_FAULT_STACK_UNDERFLOW 0x20000
+#define JIT_FAULT_INVALID_KEY     0x30000
+
+// block_at values that are not block indexes
+#define JIT_NONE    -1
+#define JIT_NOCODE  -2
+
+typedef uint32_t (*Jit_Fn)(Chip8 *chip8);
+
+typedef struct {
+    Jit_Fn fn;
+    uint16_t start, end; // [start, end) bytes of memory it was compiled from
+    uint16_t len;        // instructions
+    bool live;
+} Jit_Block;
+
+struct Chip8_Jit {
+    uint8_t *code;       // read/write view, blocks are emitted here
+    uint8_t *code_exec;  // read/execute view of the same pages
+    size_t code_used;
+    Jit_Block blocks[JIT_MAX_BLOCKS];
+    int block_cnt;
+    int16_t block_at[MEMORY_SIZE];
+    // one bit per byte of memory covered by a live block
+    uint8_t code_bytes[MEMORY_SIZE/8];
+};
+
+enum { RAX = 0, RCX, RDX, RBX, RSP, RBP, RSI, RDI, R8, R9, R10, R11, R12, R13, R14, R15 };
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_A = 0x7, CC_LE = 0xE, CC_GE = 0xD };
+
+// host registers V registers can be pinned to, in order of preference
+static const uint8_t pin_pool[] = { R8, R9, R10, R11, RSI, RBX, R12, R13, R14, R15 };
+#define PIN_POOL_CNT (sizeof(pin_pool)/sizeof(*pin_pool))
+
+typedef struct {
+    uint8_t *buf;
+    size_t len, cap;
+    bool overflow;
+} Emitter;
+
+// An operand: a host register or a byte at chip8 + disp, optionally indexed by rax*2
+typedef struct {
+    bool is_reg;
+    uint8_t reg;
+    bool indexed;
+    int32_t disp;
+} Loc;
+
+static Loc loc_reg(uint8_t reg) { return (Loc) { .is_reg = true, .reg = reg }; }
+static Loc loc_mem(size_t disp) { return (Loc) { .disp = (int32_t) disp }; }
+
+static void emit8(Emitter *e, uint8_t b) {
+    if (e->len >= e->cap) {
+        e->overflow = true;
+        return;
+    }
+    e->buf[e->len++] = b;
+}
+
+static void emit16(Emitter *e, uint16_t v) {
+    emit8(e, v & 0xFF);
+    emit8(e, v >> 8);
+}
+
+static void emit32(Emitter *e, uint32_t v) {
+    for (int i = 0; i < 4; i++) emit8(e, (v >> (8*i)) & 0xFF);
+}
+
+static void emit64(Emitter *e, uint64_t v) {
+    emit32(e, v & 0xFFFFFFFF);
+    emit32(e, v >> 32);
+}
+
+#define OP16 1 // operand size prefix
+#define REXW 2
+
+// [66] REX opcode... modrm [sib] [disp32]. REX is always emitted so the byte
+// forms of rsi/rdi/r8..r15 are reachable; we never touch ah..bh
+static void emit_op(Emitter *e, int flags, const uint8_t *opcode, int opcode_len, uint8_t reg, Loc rm) {
+    if (flags & OP16) emit8(e, 0x66);
+    emit8(e, 0x40 | ((flags & REXW) ? 8 : 0) | ((reg & 8) ? 4 : 0) | ((rm.is_reg && (rm.reg & 8)) ? 1 : 0));
+    for (int i = 0; i < opcode_len; i++) emit8(e, opcode[i]);
+
+    if (rm.is_reg) {
+        emit8(e, 0xC0 | (reg & 7) << 3 | (rm.reg & 7));
+    } else if (rm.indexed) {
+        emit8(e, 0x80 | (reg & 7) << 3 | 4);
+        emit8(e, 1 << 6 | RAX << 3 | RDI); // [rdi + rax*2]
+        emit32(e, rm.disp);
+    } else {
+        emit8(e, 0x80 | (reg & 7) << 3 | RDI);
+        emit32(e, rm.disp);
+    }
+}
+
+#define EMIT_OP(e, flags, reg, rm, ...) do {                        \
+        const uint8_t opcode_[] = { __VA_ARGS__ };                   \
+        emit_op(e, flags, opcode_, sizeof(opcode_), reg, rm);        \
+    } while (0)
+
+static void mov_r8_loc(Emitter *e, uint8_t reg, Loc src)  { EMIT_OP(e, 0, reg, src, 0x8A); }
+static void mov_loc_r8(Emitter *e, Loc dst, uint8_t reg)  { EMIT_OP(e, 0, reg, dst, 0x88); }
+static void mov_loc_imm8(Emitter *e, Loc dst, uint8_t v)  { EMIT_OP(e, 0, 0, dst, 0xC6); emit8(e, v); }
+static void alu_r8_loc(Emitter *e, uint8_t opc, uint8_t reg, Loc src) { EMIT_OP(e, 0, reg, src, opc); }
+static void alu_loc_imm8(Emitter *e, uint8_t ext, Loc dst, uint8_t v) { EMIT_OP(e, 0, ext, dst, 0x80); emit8(e, v); }
+static void shift_loc_imm8(Emitter *e, uint8_t ext, Loc dst, uint8_t v) { EMIT_OP(e, 0, ext, dst, 0xC0); emit8(e, v); }
+static void setcc_loc(Emitter *e, uint8_t cc, Loc dst)    { EMIT_OP(e, 0, 0, dst, 0x0F, 0x90 | cc); }
+static void shift1_loc(Emitter *e, uint8_t ext, Loc dst)  { EMIT_OP(e, 0, ext, dst, 0xD0); }
+static void movzx_r32_loc8(Emitter *e, uint8_t reg, Loc src) { EMIT_OP(e, 0, reg, src, 0x0F, 0xB6); }
+static void movzx_r32_loc16(Emitter *e, uint8_t reg, Loc src) { EMIT_OP(e, 0, reg, src, 0x0F, 0xB7); }
+static void movsx_r32_loc8(Emitter *e, uint8_t reg, Loc src) { EMIT_OP(e, 0, reg, src, 0x0F, 0xBE); }
+static void cmov_r32(Emitter *e, uint8_t cc, uint8_t dst, uint8_t src) { EMIT_OP(e, 0, dst, loc_reg(src), 0x0F, 0x40 | cc); }
+static void mov_loc16_imm(Emitter *e, Loc dst, uint16_t v) { EMIT_OP(e, OP16, 0, dst, 0xC7); emit16(e, v); }
+static void mov_loc16_r16(Emitter *e, Loc dst, uint8_t reg) { EMIT_OP(e, OP16, reg, dst, 0x89); }
+static void add_loc16_r16(Emitter *e, Loc dst, uint8_t reg) { EMIT_OP(e, OP16, reg, dst, 0x01); }
+static void test_loc16_r16(Emitter *e, Loc dst, uint8_t reg) { EMIT_OP(e, OP16, reg, dst, 0x85); }
+static void cmp_r32_imm8(Emitter *e, uint8_t reg, uint8_t v) { EMIT_OP(e, 0, 7, loc_reg(reg), 0x83); emit8(e, v); }
+
+static void mov_r32_imm(Emitter *e, uint8_t reg, uint32_t v) {
+    if (reg & 8) emit8(e, 0x41);
+    emit8(e, 0xB8 | (reg & 7));
+    emit32(e, v);
+}
+
+static void mov_r64_imm(Emitter *e, uint8_t reg, uint64_t v) {
+    emit8(e, 0x48 | ((reg & 8) ? 1 : 0));
+    emit8(e, 0xB8 | (reg & 7));
+    emit64(e, v);
+}
+
+static void push_r64(Emitter *e, uint8_t reg) {
+    if (reg & 8) emit8(e, 0x41);
+    emit8(e, 0x50 | (reg & 7));
+}
+
+static void pop_r64(Emitter *e, uint8_t reg) {
+    if (reg & 8) emit8(e, 0x41);
+    emit8(e, 0x58 | (reg & 7));
+}
+
+// returns the offset of the rel32 to patch
+static size_t jcc_rel32(Emitter *e, uint8_t cc) {
+    emit8(e, 0x0F);
+    emit8(e, 0x80 | cc);
+    size_t at = e->len;
+    emit32(e, 0);
+    return at;
+}
+
+static size_t jmp_rel32(Emitter *e) {
+    emit8(e, 0xE9);
+    size_t at = e->len;
+    emit32(e, 0);
+    return at;
+}
+
+static void patch_rel32(Emitter *e, size_t at, size_t target) {
+    if (e->overflow) return;
+    int32_t rel = (int32_t) (target - (at + 4));
+    memcpy(e->buf + at, &rel, sizeof(rel));
+}
+
+static bool is_callee_saved(uint8_t reg) {
+    return reg == RBX || reg >= R12;
+}
+
+static bool jit_ends_block(Op_Type type) {
+    switch (type) {
+        case OP_JP_ADDR: case OP_JP_V0_ADDR: case OP_CALL: case OP_RET:
+        case OP_SE_RB: case OP_SE_RR: case OP_SNE_R_B: case OP_SNE_R_R:
+        case OP_SKP: case OP_SKNP:
+            return true;
+        default:
+            return false;
+    }
+}
+
+static bool jit_translates(Op_Type type) {
+    switch (type) {
+        case OP_LD_R_B: case OP_LD_R_R: case OP_ADD_R_B: case OP_ADD_R_R:
+        case OP_OR: case OP_AND: case OP_XOR: case OP_SUB: case OP_SUBN:
+        case OP_SHR: case OP_SHL: case OP_LD_I_ADDR: case OP_ADD_I_R:
+        case OP_LD_FONT_R: case OP_LD_R_DT: case OP_LD_DT_R:
+            return true;
+        default:
+            return jit_ends_block(type);
+    }
+}
+
+typedef struct {
+    Loc v[0x10];
+    Loc regi, delay_timer, sp, keyboard;
+    // the profile of the machine, its quirks are compiled into the block
+    const Chip8_Quirk_Set *quirks;
+    size_t bail_jumps[4];
+    uint32_t bail_codes[4];
+    int bail_cnt;
+} Jit_Ctx;
+
+static void bail_if(Emitter *e, Jit_Ctx *ctx, uint8_t cc, uint32_t code) {
+    ctx->bail_jumps[ctx->bail_cnt] = jcc_rel32(e, cc);
+    ctx->bail_codes[ctx->bail_cnt++] = code;
+}
+
+// eax = cond ? taken : not_taken, flags already set by the caller
+static void select_pc(Emitter *e, uint8_t cc, uint16_t taken, uint16_t not_taken) {
+    mov_r32_imm(e, RAX, not_taken);
+    mov_r32_imm(e, RDX, taken);
+    cmov_r32(e, cc, RAX, RDX);
+}
+
+static void emit_instruction(Emitter *e, Jit_Ctx *ctx, uint16_t pc, Op op, Op_Type type) {
+    uint8_t x = (op & 0x0F00) >> 8;
+    uint8_t y = (op & 0x00F0) >> 4;
+    uint8_t kk = op & 0x00FF;
+    uint16_t nnn = op & 0x0FFF;
+    Loc vx = ctx->v[x], vy = ctx->v[y], vf = ctx->v[0xF];
+
+    switch (type) {
+        case OP_LD_R_B:
+            mov_loc_imm8(e, vx, kk);
+            break;
+        case OP_LD_R_R:
+            mov_r8_loc(e, RAX, vy);
+            mov_loc_r8(e, vx, RAX);
+            break;
+        case OP_ADD_R_B:
+            alu_loc_imm8(e, 0, vx, kk);
+            break;
+        case OP_ADD_R_R:
+            mov_r8_loc(e, RAX, vx);
+            alu_r8_loc(e, 0x02, RAX, vy);
+            setcc_loc(e, CC_B, loc_reg(RCX));
+            mov_loc_r8(e, vx, RAX);
+            mov_loc_r8(e, vf, RCX);
+            break;
+        case OP_OR:
+        case OP_AND:
+        case OP_XOR:
+            mov_r8_loc(e, RAX, vx);
+            alu_r8_loc(e, type == OP_OR ? 0x0A : type == OP_AND ? 0x22 : 0x32, RAX, vy);
+            mov_loc_r8(e, vx, RAX);
+            if (ctx->quirks->vf_reset) mov_loc_imm8(e, vf, 0);
+            break;
+        case OP_SUB:
+        case OP_SUBN:
+            mov_r8_loc(e, RAX, type == OP_SUB ? vx : vy);
+            alu_r8_loc(e, 0x2A, RAX, type == OP_SUB ? vy : vx);
+            setcc_loc(e, CC_AE, loc_reg(RCX));
+            mov_loc_r8(e, vx, RAX);
+            mov_loc_r8(e, vf, RCX);
+            break;
+        case OP_SHR:
+            mov_r8_loc(e, RAX, ctx->quirks->shift_vx ? vx : vy);
+            mov_r8_loc(e, RCX, loc_reg(RAX));
+            alu_loc_imm8(e, 4, loc_reg(RCX), 1);
+            shift1_loc(e, 5, loc_reg(RAX));
+            mov_loc_r8(e, vx, RAX);
+            mov_loc_r8(e, vf, RCX);
+            break;
+        case OP_SHL:
+            mov_r8_loc(e, RAX, ctx->quirks->shift_vx ? vx : vy);
+            mov_r8_loc(e, RCX, loc_reg(RAX));
+            shift_loc_imm8(e, 5, loc_reg(RCX), 7);
+            shift1_loc(e, 4, loc_reg(RAX));
+            mov_loc_r8(e, vx, RAX);
+            mov_loc_r8(e, vf, RCX);
+            break;
+        case OP_LD_I_ADDR:
+            mov_loc16_imm(e, ctx->regi, nnn);
+            break;
+        case OP_ADD_I_R:
+            movzx_r32_loc8(e, RAX, vx);
+            add_loc16_r16(e, ctx->regi, RAX);
+            break;
+        case OP_LD_FONT_R:
+            movzx_r32_loc8(e, RAX, vx);
+            emit8(e, 0x8D); emit8(e, 0x04); emit8(e, 0x80); // lea eax, [rax + rax*4]
+            mov_loc16_r16(e, ctx->regi, RAX);
+            break;
+        case OP_LD_R_DT:
+            mov_r8_loc(e, RAX, ctx->delay_timer);
+            mov_loc_r8(e, vx, RAX);
+            break;
+        case OP_LD_DT_R:
+            mov_r8_loc(e, RAX, vx);
+            mov_loc_r8(e, ctx->delay_timer, RAX);
+            break;
+
+        case OP_JP_ADDR:
+            mov_r32_imm(e, RAX, nnn);
+            break;
+        case OP_JP_V0_ADDR:
+            movzx_r32_loc8(e, RAX, ctx->quirks->jump_vx ? vx : ctx->v[0]);
+            emit8(e, 0x05); emit32(e, nnn); // add eax, nnn
+            break;
+        case OP_SE_RB:
+        case OP_SNE_R_B:
+            alu_loc_imm8(e, 7, vx, kk);
+            select_pc(e, type == OP_SE_RB ? CC_E : CC_NE, pc + 4, pc + 2);
+            break;
+        case OP_SE_RR:
+        case OP_SNE_R_R:
+            mov_r8_loc(e, RCX, vx);
+            alu_r8_loc(e, 0x3A, RCX, vy);
+            select_pc(e, type == OP_SE_RR ? CC_E : CC_NE, pc + 4, pc + 2);
+            break;
+        case OP_SKP:
+        case OP_SKNP:
+            movzx_r32_loc8(e, RAX, vx);
+            cmp_r32_imm8(e, RAX, 0xF);
+            bail_if(e, ctx, CC_A, JIT_FAULT_INVALID_KEY | pc);
+            mov_r64_imm(e, RDX, (uint64_t) (uintptr_t) chip8_key_masks);
+            emit8(e, 0x0F); emit8(e, 0xB7); emit8(e, 0x14); emit8(e, 0x42); // movzx edx, word [rdx + rax*2]
+            test_loc16_r16(e, ctx->keyboard, RDX);
+            select_pc(e, type == OP_SKP ? CC_NE : CC_E, pc + 4, pc + 2);
+            break;
+        case OP_CALL: {
+            movsx_r32_loc8(e, RAX, ctx->sp);
+            cmp_r32_imm8(e, RAX, STACK_SIZE);
+            bail_if(e, ctx, CC_GE, JIT_FAULT_STACK_OVERFLOW | pc);
+            Loc slot = loc_mem(offsetof(Chip8, stack));
+            slot.indexed = true;
+            mov_loc16_imm(e, slot, pc + 2);
+            alu_loc_imm8(e, 0, ctx->sp, 1);
+            mov_r32_imm(e, RAX, nnn);
+        } break;
+        case OP_RET: {
+            movsx_r32_loc8(e, RAX, ctx->sp);
+            cmp_r32_imm8(e, RAX, 0);
+            bail_if(e, ctx, CC_LE, JIT_FAULT_STACK_UNDERFLOW | pc);
+            alu_loc_imm8(e, 5, ctx->sp, 1);
+            emit8(e, 0xFF); emit8(e, 0xC8); // dec eax
+            Loc slot = loc_mem(offsetof(Chip8, stack));
+            slot.indexed = true;
+            movzx_r32_loc16(e, RAX, slot);
+        } break;
+
+        default:
+            break;
+    }
+}
+
+static void jit_flush(Chip8_Jit *jit) {
+    jit->code_used = 0;
+    jit->block_cnt = 0;
+    memset(jit->block_at, 0xFF, sizeof(jit->block_at)); // JIT_NONE
+    memset(jit->code_bytes, 0, sizeof(jit->code_bytes));
+}
+
+static int jit_compile(Chip8_Jit *jit, const Chip8 *chip8, uint16_t start) {
+    Op ops[JIT_MAX_BLOCK_LEN];
+    Op_Type types[JIT_MAX_BLOCK_LEN];
+    int len = 0;
+    uint16_t pc = start;
+    while (len < JIT_MAX_BLOCK_LEN && pc <= MEMORY_SIZE - 2) {
+        Op op = chip8_op_at(chip8, pc);
+        Op_Type type = op_decode(op);
+        if (!jit_translates(type)) break;
+
+        ops[len] = op;
+        types[len++] = type;
+        pc += 2;
+        if (jit_ends_block(type)) break;
+    }
+
+    if (len == 0) return JIT_NOCODE;
+
+    if (jit->block_cnt >= JIT_MAX_BLOCKS || JIT_CODE_SIZE - jit->code_used < 4096) {
+        jit_flush(jit);
+    }
+
+    // pin the registers used more than once, most used first
+    int uses[0x10] = {0};
+    for (int i = 0; i < len; i++) {
+        switch (types[i]) {
+            case OP_LD_I_ADDR: case OP_JP_ADDR: case OP_CALL: case OP_RET:
+                break;
+            case OP_JP_V0_ADDR:
+                uses[chip8_quirk_sets[chip8->quirks].jump_vx ? (ops[i] & 0x0F00) >> 8 : 0]++;
+                break;
+            case OP_LD_R_R: case OP_ADD_R_R: case OP_OR: case OP_AND: case OP_XOR:
+            case OP_SUB: case OP_SUBN: case OP_SHR: case OP_SHL: case OP_SE_RR: case OP_SNE_R_R:
+                uses[(ops[i] & 0x00F0) >> 4]++;
+                // fallthrough
+            default:
+                uses[(ops[i] & 0x0F00) >> 8]++;
+                break;
+        }
+    }
+
+    Jit_Ctx ctx = {0};
+    for (int r = 0; r < 0x10; r++) {
+        ctx.v[r] = loc_mem(offsetof(Chip8, regs) + r);
+    }
+    ctx.regi = loc_mem(offsetof(Chip8, regi));
+    ctx.delay_timer = loc_mem(offsetof(Chip8, delay_timer));
+    ctx.sp = loc_mem(offsetof(Chip8, sp));
+    ctx.keyboard = loc_mem(offsetof(Chip8, keyboard));
+    ctx.quirks = &chip8_quirk_sets[chip8->quirks];
+
+    int pinned[PIN_POOL_CNT];
+    size_t pinned_cnt = 0;
+    while (pinned_cnt < PIN_POOL_CNT) {
+        int best = -1;
+        for (int r = 0; r < 0x10; r++) {
+            if (!ctx.v[r].is_reg && uses[r] >= 2 && (best < 0 || uses[r] > uses[best])) best = r;
+        }
+        if (best < 0) break;
+        ctx.v[best] = loc_reg(pin_pool[pinned_cnt]);
+        pinned[pinned_cnt++] = best;
+    }
+
+    Emitter e = {
+        .buf = jit->code + jit->code_used,
+        .cap = JIT_CODE_SIZE - jit->code_used,
+    };
+
+    for (size_t i = 0; i < pinned_cnt; i++) {
+        if (is_callee_saved(pin_pool[i])) push_r64(&e, pin_pool[i]);
+    }
+    for (size_t i = 0; i < pinned_cnt; i++) {
+        mov_r8_loc(&e, pin_pool[i], loc_mem(offsetof(Chip8, regs) + pinned[i]));
+    }
+
+    pc = start;
+    for (int i = 0; i < len; i++, pc += 2) {
+        emit_instruction(&e, &ctx, pc, ops[i], types[i]);
+    }
+
+    if (!jit_ends_block(types[len - 1])) {
+        mov_r32_imm(&e, RAX, pc);
+    }
+
+    size_t epilogue = e.len;
+    for (size_t i = 0; i < pinned_cnt; i++) {
+        mov_loc_r8(&e, loc_mem(offsetof(Chip8, regs) + pinned[i]), pin_pool[i]);
+    }
+    for (size_t i = pinned_cnt; i-- > 0;) {
+        if (is_callee_saved(pin_pool[i])) pop_r64(&e, pin_pool[i]);
+    }
+    emit8(&e, 0xC3); // ret
+
+    for (int i = 0; i < ctx.bail_cnt; i++) {
+        patch_rel32(&e, ctx.bail_jumps[i], e.len);
+        mov_r32_imm(&e, RAX, ctx.bail_codes[i]);
+        patch_rel32(&e, jmp_rel32(&e), epilogue);
+    }
+
+    if (e.overflow) return JIT_NOCODE;
+
+    int index = jit->block_cnt++;
+    Jit_Block *block = &jit->blocks[index];
+    block->fn = (Jit_Fn) (void *) (jit->code_exec + jit->code_used);
+    block->start = start;
+    block->end = pc;
+    block->len = len;
+    block->live = true;
+    jit->code_used += (e.len + 15) & ~(size_t) 15;
+
+    for (uint16_t a = start; a < pc; a++) {
+        jit->code_bytes[a >> 3] |= 1 << (a & 7);
+    }
+
+    return index;
+}
+
+bool chip8_jit_enable(Chip8 *chip8) {
+    if (chip8->jit) return true;
+
+    Chip8_Jit *jit = malloc(sizeof(*jit));
+    if (jit == NULL) return false;
+
+    int fd = memfd_create("chip8-jit", MFD_CLOEXEC);
+    if (fd < 0) {
+        free(jit);
+        return false;
+    }
+
+    jit->code = MAP_FAILED;
+    jit->code_exec = MAP_FAILED;
+    if (ftruncate(fd, JIT_CODE_SIZE) == 0) {
+        jit->code = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        jit->code_exec = mmap(NULL, JIT_CODE_SIZE, PROT_READ | PROT_EXEC, MAP_SHARED, fd, 0);
+    }
+    close(fd); // the mappings keep the memory alive
+
+    if (jit->code == MAP_FAILED || jit->code_exec == MAP_FAILED) {
+        if (jit->code != MAP_FAILED) munmap(jit->code, JIT_CODE_SIZE);
+        if (jit->code_exec != MAP_FAILED) munmap(jit->code_exec, JIT_CODE_SIZE);
+        free(jit);
+        return false;
+    }
+
+    jit_flush(jit);
+    chip8->jit = jit;
+    return true;
+}
+
+void chip8_jit_disable(Chip8 *chip8) {
+    if (chip8->jit == NULL) return;
+    munmap(chip8->jit->code, JIT_CODE_SIZE);
+    munmap(chip8->jit->code_exec, JIT_CODE_SIZE);
+    free(chip8->jit);
+    chip8->jit = NULL;
+}
+
+void chip8_jit_invalidate(Chip8_Jit *jit, uint16_t addr, uint16_t len) {
+    uint32_t end = (uint32_t) addr + len;
+    if (end > MEMORY_SIZE) end = MEMORY_SIZE;
+
+    // an instruction starting on the byte before the write is changed too
+    uint16_t from = addr > 0 ? addr - 1 : 0;
+    for (uint32_t a = from; a < end; a++) {
+        if (jit->block_at[a] == JIT_NOCODE) jit->block_at[a] = JIT_NONE;
+    }
+
+    bool hit = false;
+    for (uint32_t a = addr; a < end; a++) {
+        if (jit->code_bytes[a >> 3] & (1 << (a & 7))) {
+            hit = true;
+            break;
+        }
+    }
+    if (!hit) return;
+
+    for (int i = 0; i < jit->block_cnt; i++) {
+        Jit_Block *block = &jit->blocks[i];
+        if (block->live && block->start < end && addr < block->end) {
+            block->live = false;
+            jit->block_at[block->start] = JIT_NONE;
+            for (uint16_t a = block->start; a < block->end; a++) {
+                jit->code_bytes[a >> 3] &= ~(1 << (a & 7));
+            }
+        }
+    }
+
+    // blocks can overlap, so put back the bits of the ones still alive
+    for (int i = 0; i < jit->block_cnt; i++) {
+        Jit_Block *block = &jit->blocks[i];
+        if (!block->live) continue;
+        for (uint16_t a = block->start; a < block->end; a++) {
+            jit->code_bytes[a >> 3] |= 1 << (a & 7);
+        }
+    }
+}
+
+Chip8_Status chip8_jit_run(Chip8 *chip8, int n) {
+    Chip8_Jit *jit = chip8->jit;
+    while (n > 0 && !chip8->waiting_for_key && !chip8->waiting_for_vblank) {
+        uint16_t pc = chip8->pc;
+        // an idle loop takes the rest of the cycles without running
+        if (pc <= MEMORY_SIZE - 2 && (chip8->memory[pc] & 0xF0) == 0xF0 && chip8->memory[pc + 1] == 0x07 &&
+            chip8_skip_idle(chip8, n)) {
+            break;
+        }
+
+        int index = JIT_NOCODE;
+        if ((pc & 1) == 0 && pc <= MEMORY_SIZE - 2) {
+            index = jit->block_at[pc];
+            if (index == JIT_NONE) {
+                index = jit_compile(jit, chip8, pc);
+                jit->block_at[pc] = index;
+            }
+        }
+
+        if (index < 0 || jit->blocks[index].len > n) {
+            Chip8_Status status = chip8_interpret(chip8, 1);
+            if (status != CHIP8_OK) return status;
+            n--;
+            continue;
+        }
+
+        Jit_Block *block = &jit->blocks[index];
+        uint32_t ret = block->fn(chip8);
+        if (ret > 0xFFFF) {
+            // the terminator failed, everything before it ran. Like in the
+            // interpreter the faulting instruction still takes its cycle
+            chip8->pc = ret & 0xFFFF;
+            chip8->cycles -= block->len;
+            switch (ret & ~0xFFFF) {
+                case JIT_FAULT_STACK_OVERFLOW:  return CHIP8_ERR_STACK_OVERFLOW;
+                case JIT_FAULT_STACK_UNDERFLOW: return CHIP8_ERR_STACK_UNDERFLOW;
+                default:                        return CHIP8_ERR_INVALID_KEY;
+            }
+        }
+
+        chip8->pc = ret;
+        chip8->cycles -= block->len;
+        n -= block->len;
+    }
+
+    return CHIP8_OK;
+}
+
+#else
+
+bool chip8_jit_enable(Chip8 *chip8) {
+    (void) chip8;
+    return false;
+}
+
+void chip8_jit_disable(Chip8 *chip8) {
+    (void) chip8;
+}
+
+void chip8_jit_invalidate(Chip8_Jit *jit, uint16_t addr, uint16_t len) {
+    (void) jit;
+    (void) addr;
+    (void) len;
+}
+
+Chip8_Status chip8_jit_run(Chip8 *chip8, int n) {
+    return chip8_interpret(chip8, n);
+}
+
+#endif
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
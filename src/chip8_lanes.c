@@ -0,0 +1,239 @@
+#include <string.h>
+
+#include "chip8_lanes.h"
+
+typedef Chip8_Lane_Vec Vec;
+typedef Chip8_Lane_Vec16 Vec16;
+
+// Rough cost, in instructions of the scalar core, of forming a group and of running
+// an instruction lane by lane from here. A run that spent more on them than it ran in
+// lockstep is followed by some runs on the scalar core, twice as many each time it
+// happens again, up to MAX_BACKOFF
+#define GROUP_COST 40
+#define LANE_STEP_COST 10
+#define MAX_BACKOFF 256
+
+#define SELECT(m, a, b) (((a) & (m)) | ((b) & ~(m)))
+#define FOR_LANES(l, mask) for (uint32_t _m = (mask), l; _m && (l = __builtin_ctz(_m), 1); _m &= _m - 1)
+
+static void lane_load(Chip8_Lanes *lanes, const Chip8 *chip8, int l) {
+    for (int r = 0; r < 0x10; r++) lanes->regs[r][l] = chip8->regs[r];
+    lanes->delay_timer[l] = chip8->delay_timer;
+    lanes->regi[l] = chip8->regi;
+    lanes->pc[l] = chip8->pc;
+    lanes->cycles[l] = chip8->cycles;
+}
+
+static void lane_store(const Chip8_Lanes *lanes, Chip8 *chip8, int l) {
+    for (int r = 0; r < 0x10; r++) chip8->regs[r] = lanes->regs[r][l];
+    chip8->delay_timer = lanes->delay_timer[l];
+    chip8->regi = lanes->regi[l];
+    chip8->pc = lanes->pc[l];
+    chip8->cycles = lanes->cycles[l];
+}
+
+// A group runs together while its lanes are at the same pc, and only holds lanes of
+// one quirk profile. Only the ops that don't leave the registers are executed as
+// vectors, anything else ends the run and is executed lane by lane.
+typedef struct {
+    uint32_t lanes;
+    Vec m;
+    Vec16 m16;
+    uint16_t pc;
+    // words already checked to be the same in every lane of the group
+    uint64_t checked[MEMORY_SIZE/2/64];
+} Group;
+
+static void group_set(Group *g, uint32_t lanes) {
+    g->lanes = lanes;
+    for (int l = 0; l < CHIP8_LANES; l++) {
+        g->m[l] = (lanes >> l) & 1 ? 0xFF : 0;
+        g->m16[l] = (lanes >> l) & 1 ? 0xFFFF : 0;
+    }
+}
+
+#define RUN_VECTOR run_vector_chip8
+#define QUIRKS CHIP8_QUIRKS_CHIP8
+#include "chip8_lanes_vector.h"
+
+#define RUN_VECTOR run_vector_vip
+#define QUIRKS CHIP8_QUIRKS_VIP
+#include "chip8_lanes_vector.h"
+
+#define RUN_VECTOR run_vector_chip48
+#define QUIRKS CHIP8_QUIRKS_CHIP48
+#include "chip8_lanes_vector.h"
+
+#define RUN_VECTOR run_vector_schip
+#define QUIRKS CHIP8_QUIRKS_SCHIP
+#include "chip8_lanes_vector.h"
+
+#define RUN_VECTOR run_vector_xochip
+#define QUIRKS CHIP8_QUIRKS_XOCHIP
+#include "chip8_lanes_vector.h"
+
+typedef int (*Run_Vector)(Chip8_Lanes *lanes, const Group *g, Op op);
+
+static const Run_Vector run_vectors[__CHIP8_QUIRKS_CNT__] = {
+    [CHIP8_QUIRKS_CHIP8]  = run_vector_chip8,
+    [CHIP8_QUIRKS_VIP]    = run_vector_vip,
+    [CHIP8_QUIRKS_CHIP48] = run_vector_chip48,
+    [CHIP8_QUIRKS_SCHIP]  = run_vector_schip,
+    [CHIP8_QUIRKS_XOCHIP] = run_vector_xochip,
+};
+
+void chip8_lanes_run(Chip8_Lanes *lanes, Chip8 **machines, int count, Chip8_Status *status) {
+    if (count > CHIP8_LANES) count = CHIP8_LANES;
+
+    if (lanes->scalar_runs > 0) {
+        lanes->scalar_runs--;
+        for (int l = 0; l < count; l++) {
+            int before = machines[l]->cycles;
+            status[l] = chip8_run_cycles(machines[l], machines[l]->cycles);
+            lanes->scalar_ops += before - machines[l]->cycles;
+        }
+        return;
+    }
+
+    uint32_t active = 0;
+    for (int l = 0; l < count; l++) {
+        status[l] = CHIP8_OK;
+        lane_load(lanes, machines[l], l);
+        if (!machines[l]->waiting_for_key && !machines[l]->waiting_for_vblank && machines[l]->cycles > 0) {
+            active |= 1u << l;
+        }
+    }
+
+    // groups formed, instructions run in lockstep (per lane) and lane by lane
+    uint64_t groups = 0, lane_ops = 0, lane_steps = 0;
+    Group g;
+    // even pcs where lanes outside of the group are waiting
+    uint64_t waiting[MEMORY_SIZE/2/64];
+    while (active) {
+        // lowest pc first: the lanes that branched ahead wait at the join point
+        // for the others to get there, then they run together again
+        int lead = __builtin_ctz(active);
+        FOR_LANES(l, active) {
+            if (lanes->pc[l] < lanes->pc[lead]) lead = l;
+        }
+
+        // the lanes of another profile never join the group, so it does not wait for them
+        Chip8_Quirks quirks = machines[lead]->quirks;
+        uint32_t members = 0;
+        int budget = lanes->cycles[lead];
+        memset(waiting, 0, sizeof(waiting));
+        FOR_LANES(l, active) {
+            if (machines[l]->quirks != quirks) continue;
+
+            uint16_t pc = lanes->pc[l];
+            if (pc != lanes->pc[lead]) {
+                waiting[(pc >> 1)/64 % (MEMORY_SIZE/2/64)] |= 1ull << ((pc >> 1)%64);
+                continue;
+            }
+
+            members |= 1u << l;
+            if (lanes->cycles[l] < budget) budget = lanes->cycles[l];
+        }
+
+        group_set(&g, members);
+        g.pc = lanes->pc[lead];
+        Run_Vector run_vector = run_vectors[quirks];
+        memset(g.checked, 0, sizeof(g.checked));
+
+        // the pc and cycles of the members are only written back when the run ends
+        int executed = 0;
+        bool merge = false;
+        while (executed < budget && !(g.pc & ~(MEMORY_SIZE - 2))) {
+            uint16_t w = g.pc >> 1;
+            Op op = chip8_op_at(machines[lead], g.pc);
+            if (!(g.checked[w/64] & (1ull << (w%64)))) {
+                // every machine has its own memory, the lanes holding another word leave
+                uint32_t others = 0;
+                FOR_LANES(l, g.lanes) {
+                    if (chip8_op_at(machines[l], g.pc) != op) others |= 1u << l;
+                }
+
+                if (others) {
+                    FOR_LANES(l, others) {
+                        lanes->pc[l] = g.pc;
+                        lanes->cycles[l] -= executed;
+                    }
+
+                    group_set(&g, g.lanes & ~others);
+                    memset(g.checked, 0, sizeof(g.checked));
+                }
+
+                g.checked[w/64] |= 1ull << (w%64);
+            }
+
+            // the Fx07 of a loop back to it may be an idle loop, those are skipped lane by lane
+            if (op_decode(op) == OP_LD_R_DT && chip8_op_at(machines[lead], g.pc + 4) == (0x1000 | g.pc)) break;
+
+            int next = run_vector(lanes, &g, op);
+            if (next < 0) break;
+
+            g.pc = next;
+            executed++;
+            uint16_t n = (g.pc >> 1) % (MEMORY_SIZE/2);
+            if (waiting[n/64] & (1ull << (n%64))) {
+                merge = true;
+                break;
+            }
+        }
+
+        groups++;
+        lane_ops += (uint64_t) executed*__builtin_popcount(g.lanes);
+        FOR_LANES(l, g.lanes) {
+            lanes->pc[l] = g.pc;
+            lanes->cycles[l] -= executed;
+            if (lanes->cycles[l] <= 0) {
+                active &= ~(1u << l);
+                g.lanes &= ~(1u << l);
+            }
+        }
+
+        if (merge) continue;
+
+        // the instruction that stopped the run, one lane at a time
+        FOR_LANES(l, g.lanes) {
+            Chip8 *chip8 = machines[l];
+            lane_store(lanes, chip8, l);
+            status[l] = CHIP8_OK;
+            if (chip8_skip_idle(chip8, chip8->cycles) == 0) status[l] = chip8_interpret(chip8, 1);
+            lane_load(lanes, chip8, l);
+            if (status[l] != CHIP8_OK || chip8->waiting_for_key || chip8->waiting_for_vblank || chip8->cycles <= 0) {
+                active &= ~(1u << l);
+            }
+        }
+
+        lane_steps += __builtin_popcount(g.lanes);
+    }
+
+    for (int l = 0; l < count; l++) {
+        lane_store(lanes, machines[l], l);
+    }
+
+    lanes->vector_ops += lane_ops;
+    lanes->scalar_ops += lane_steps;
+    if (groups*GROUP_COST + lane_steps*LANE_STEP_COST > lane_ops) {
+        lanes->backoff = lanes->backoff ? lanes->backoff*2 : 1;
+        if (lanes->backoff > MAX_BACKOFF) lanes->backoff = MAX_BACKOFF;
+        lanes->scalar_runs = lanes->backoff;
+    } else {
+        lanes->backoff = 0;
+    }
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
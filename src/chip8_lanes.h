@@ -0,0 +1,43 @@
+#ifndef CHIP8_LANES_H_
+#define CHIP8_LANES_H_
+
+#include "chip8.h"
+
+// Lockstep execution of up to CHIP8_LANES machines. The registers of every machine
+// are laid out across lanes (regs[x][lane]), so when several machines sit at the same
+// pc on the same instruction, an ALU op, skip or jump runs once for all of them with
+// vector instructions. Lanes whose pc differs are masked out and regrouped as soon as
+// they meet again, and only machines of the same quirk profile run together. Everything
+// that touches memory, the screen, the stack or the keyboard goes through the scalar
+// interpreter one lane at a time.
+//
+// The vectors are GCC vector extensions, so the width the host has is used: build with
+// `-mavx2` (or -march=native) to get 32 lanes per instruction instead of 2x16 with SSE2.
+
+#define CHIP8_LANES 32
+
+typedef uint8_t Chip8_Lane_Vec __attribute__((vector_size(CHIP8_LANES)));
+typedef uint16_t Chip8_Lane_Vec16 __attribute__((vector_size(CHIP8_LANES*2)));
+
+typedef struct {
+    Chip8_Lane_Vec regs[0x10];
+    Chip8_Lane_Vec delay_timer;
+    Chip8_Lane_Vec16 regi;
+    uint16_t pc[CHIP8_LANES];
+    int cycles[CHIP8_LANES];
+
+    // runs left on the scalar core, after a run where the lanes hardly met
+    int scalar_runs;
+    int backoff;
+    // instructions run for a whole group, and run lane by lane
+    uint64_t vector_ops;
+    uint64_t scalar_ops;
+} Chip8_Lanes;
+
+// Runs machines[0..count) as chip8_run_cycles(machines[i], machines[i]->cycles) would,
+// leaving every machine in exactly the state the scalar core leaves it, and stores the
+// result of each one in status[i]. lanes must be zeroed before the first run and then
+// kept for the following frames of the same machines
+void chip8_lanes_run(Chip8_Lanes *lanes, Chip8 **machines, int count, Chip8_Status *status);
+
+#endif // CHIP8_LANES_H_
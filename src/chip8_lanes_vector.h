@@ -0,0 +1,107 @@
+// The vector step of the lanes, as a template: chip8_lanes.c includes this file once per
+// quirk profile, with RUN_VECTOR set to the name of the function to define and QUIRKS to
+// the profile, like src/chip8_interpret.h. A group only holds lanes of one profile, so
+// the quirks are constants here and each instance only has the code of its own.
+//
+// Executes op for the group and returns the next pc, or -1 when it has to be executed
+// lane by lane (not vectorizable, or the lanes go different ways).
+//
+// Not a header of its own: it uses the statics of chip8_lanes.c
+
+#define QUIRK(field) (chip8_quirk_sets[QUIRKS].field)
+
+static int RUN_VECTOR(Chip8_Lanes *lanes, const Group *g, Op op) {
+    Vec m = g->m;
+    Vec *regs = lanes->regs;
+    uint8_t x = (op & 0x0F00) >> 8;
+    uint8_t y = (op & 0x00F0) >> 4;
+    uint8_t kk = op & 0x00FF;
+    uint16_t nnn = op & 0x0FFF;
+    Vec vx = regs[x], vy = regs[y];
+    // lanes of the group that skip the next instruction
+    uint32_t skip = 0;
+    Vec cond;
+
+    switch (op_decode(op)) {
+    case OP_SE_RB:    cond = (Vec) (vx == kk); goto skip_if;
+    case OP_SE_RR:    cond = (Vec) (vx == vy); goto skip_if;
+    case OP_SNE_R_B:  cond = (Vec) (vx != kk); goto skip_if;
+    case OP_SNE_R_R:  cond = (Vec) (vx != vy); goto skip_if;
+    skip_if:
+        for (int l = 0; l < CHIP8_LANES; l++) skip |= (uint32_t) (cond[l] & 1) << l;
+        skip &= g->lanes;
+        if (skip == 0) return g->pc + 2;
+        if (skip == g->lanes) return g->pc + 4;
+        return -1;
+    case OP_OR:
+        regs[x] = SELECT(m, vx | vy, vx);
+        if (QUIRK(vf_reset)) regs[0xF] = SELECT(m, (Vec) {0}, regs[0xF]);
+        break;
+    case OP_AND:
+        regs[x] = SELECT(m, vx & vy, vx);
+        if (QUIRK(vf_reset)) regs[0xF] = SELECT(m, (Vec) {0}, regs[0xF]);
+        break;
+    case OP_XOR:
+        regs[x] = SELECT(m, vx ^ vy, vx);
+        if (QUIRK(vf_reset)) regs[0xF] = SELECT(m, (Vec) {0}, regs[0xF]);
+        break;
+    case OP_SUB:
+        regs[x] = SELECT(m, vx - vy, vx);
+        regs[0xF] = SELECT(m, (Vec) (vx >= vy) & 1, regs[0xF]);
+        break;
+    case OP_SUBN:
+        regs[x] = SELECT(m, vy - vx, vx);
+        regs[0xF] = SELECT(m, (Vec) (vy >= vx) & 1, regs[0xF]);
+        break;
+    case OP_SHR: {
+        Vec v = QUIRK(shift_vx) ? vx : vy;
+        regs[x] = SELECT(m, v >> 1, vx);
+        regs[0xF] = SELECT(m, v & 1, regs[0xF]);
+        break;
+    }
+    case OP_SHL: {
+        Vec v = QUIRK(shift_vx) ? vx : vy;
+        regs[x] = SELECT(m, v << 1, vx);
+        regs[0xF] = SELECT(m, v >> 7, regs[0xF]);
+        break;
+    }
+    case OP_ADD_R_B:
+        regs[x] = SELECT(m, vx + kk, vx);
+        break;
+    case OP_ADD_R_R: {
+        Vec t = vx + vy;
+        regs[x] = SELECT(m, t, vx);
+        regs[0xF] = SELECT(m, (Vec) (t < vx) & 1, regs[0xF]);
+        break;
+    }
+    case OP_LD_R_B:
+        regs[x] = SELECT(m, (Vec) {0} + kk, vx);
+        break;
+    case OP_LD_R_R:
+        regs[x] = SELECT(m, vy, vx);
+        break;
+    case OP_LD_R_DT:
+        regs[x] = SELECT(m, lanes->delay_timer, vx);
+        break;
+    case OP_LD_DT_R:
+        lanes->delay_timer = SELECT(m, vx, lanes->delay_timer);
+        break;
+    case OP_LD_I_ADDR:
+        lanes->regi = SELECT(g->m16, (Vec16) {0} + nnn, lanes->regi);
+        break;
+    case OP_ADD_I_R:
+        lanes->regi = SELECT(g->m16, lanes->regi + __builtin_convertvector(vx, Vec16), lanes->regi);
+        break;
+    case OP_JP_ADDR:
+        return nnn;
+    default:
+        // Bnnn is left out too, V0 is hardly the same everywhere
+        return -1;
+    }
+
+    return g->pc + 2;
+}
+
+#undef QUIRK
+#undef RUN_VECTOR
+#undef QUIRKS
@@ -0,0 +1,380 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8.h"
+
+// Profiler: the counting itself is done by the profiled instances of the interpreter
+// (PROFILE_ENTER and PROFILE_COUNT in chip8_interpret.h), this is the setup and the reports.
+// Straight-line code is not counted, its hits are worked out here from the entries.
+
+#if defined(PROFILE)
+
+static void settle_skips(Chip8 *chip8);
+
+bool chip8_profile_enable(Chip8 *chip8) {
+    if (chip8->profile) return true;
+
+    chip8->profile = calloc(1, sizeof(*chip8->profile));
+    if (chip8->profile == NULL) return false;
+
+    chip8_profile_arrive(chip8);
+    return true;
+}
+
+// The returns still on the stack and pc are ways in that no CALL or jump the profile has
+// seen accounts for, like a Bnnn
+void chip8_profile_arrive(Chip8 *chip8) {
+    Chip8_Profile *p = chip8->profile;
+    for (int i = 0; i < chip8->sp; i++) {
+        p->entries[chip8->stack[i] & (MEMORY_SIZE - 1)]++;
+        p->dynamic_jumps[chip8->stack[i] & (MEMORY_SIZE - 1)]++;
+    }
+    p->dynamic_jumps[chip8->pc & (MEMORY_SIZE - 1)]++;
+}
+
+// The other way around: the skips so far are settled with the code that ran them, the
+// returns on the stack will not happen, and pc will not be the instruction that was got to
+// and did not run yet. The counters can go below zero here, the sums they end up in do not
+void chip8_profile_leave(Chip8 *chip8) {
+    Chip8_Profile *p = chip8->profile;
+    settle_skips(chip8);
+    for (int i = 0; i < chip8->sp; i++) {
+        p->entries[chip8->stack[i] & (MEMORY_SIZE - 1)]--;
+        p->dynamic_jumps[chip8->stack[i] & (MEMORY_SIZE - 1)]--;
+    }
+    p->dynamic_jumps[chip8->pc & (MEMORY_SIZE - 1)]--;
+}
+
+void chip8_profile_disable(Chip8 *chip8) {
+    free(chip8->profile);
+    chip8->profile = NULL;
+}
+
+static bool is_skip(Op_Type type) {
+    switch (type) {
+    case OP_SE_RB: case OP_SE_RR: case OP_SNE_R_B: case OP_SNE_R_R: case OP_SKP: case OP_SKNP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+// Whether the instruction carries on to the next one, the others count where they go as an
+// entry. A CALL gets there through its RET, once it is off the stack
+static bool goes_on(Op_Type type) {
+    return !is_skip(type) && type != OP_JP_ADDR && type != OP_JP_V0_ADDR && type != OP_RET;
+}
+
+// The returns to pc still on the stack, their CALL has gone on to pc but the RET did not happen yet
+static uint64_t pending_returns(const Chip8 *chip8, int pc) {
+    uint64_t pending = 0;
+    for (int i = 0; i < chip8->sp; i++) pending += (chip8->stack[i] & (MEMORY_SIZE - 1)) == pc;
+    return pending;
+}
+
+// What ran at pc: the decoded instruction while there is one, the word in memory otherwise
+static Op_Type type_at(const Chip8 *chip8, int pc) {
+    if ((pc & 1) == 0 && chip8->decoded[pc >> 1].handler) return chip8->decoded[pc >> 1].handler - 1;
+    return op_decode(chip8_op_at(chip8, pc));
+}
+
+void chip8_profile_hits(const Chip8 *chip8, uint64_t *hits) {
+    const Chip8_Profile *p = chip8->profile;
+    for (int pc = 0; pc < MEMORY_SIZE; pc++) {
+        if (p == NULL) {
+            hits[pc] = 0;
+            continue;
+        }
+
+        // the entries can be behind by the runs that ended at pc, never the sum
+        hits[pc] = p->entries[pc] - pending_returns(chip8, pc);
+        if (pc < 2) continue;
+        hits[pc] += p->flowed[pc - 2];
+        if (goes_on(type_at(chip8, pc - 2))) hits[pc] += hits[pc - 2] - p->pc_counted[pc - 2];
+    }
+}
+
+uint64_t chip8_profile_hits_at(const Chip8 *chip8, uint16_t pc) {
+    const Chip8_Profile *p = chip8->profile;
+    if (p == NULL) return 0;
+
+    uint64_t hits = 0;
+    for (int a = pc % MEMORY_SIZE; ; a -= 2) {
+        hits += p->entries[a] - pending_returns(chip8, a);
+        if (a < 2) return hits;
+        hits += p->flowed[a - 2];
+        if (!goes_on(type_at(chip8, a - 2))) return hits;
+        hits -= p->pc_counted[a - 2];
+    }
+}
+
+void chip8_profile_ops(const Chip8 *chip8, uint64_t *ops) {
+    const Chip8_Profile *p = chip8->profile;
+    for (int type = 0; type <= __OP_CNT__; type++) ops[type] = p ? p->ops[type] : 0;
+    if (p == NULL) return;
+
+    // plus the hits not added yet, of the instructions still decoded, and the ones at odd
+    // addresses, which are never decoded
+    uint64_t hits[MEMORY_SIZE];
+    chip8_profile_hits(chip8, hits);
+    for (int pc = 0; pc < MEMORY_SIZE; pc++) {
+        if (pc & 1) {
+            if (hits[pc]) ops[op_decode(chip8_op_at(chip8, pc))] += hits[pc];
+            continue;
+        }
+
+        uint8_t handler = chip8->decoded[pc >> 1].handler;
+        if (handler) ops[handler - 1] += hits[pc] - p->pc_counted[pc];
+    }
+}
+
+static const char *type_name(Op_Type type) {
+    return type < __OP_CNT__ ? op_names[type] : "INVALID";
+}
+
+// The jumps into every address: Bnnn were counted, JP and CALL go where they say and every
+// CALL returns to the instruction after it, but for the ones still on the stack. The code
+// that ran before it was written over is in dynamic_jumps as well
+static void jumps_into(const Chip8 *chip8, const uint64_t *hits, uint64_t *jumps_in) {
+    const Chip8_Profile *p = chip8->profile;
+    memcpy(jumps_in, p->dynamic_jumps, MEMORY_SIZE*sizeof(*jumps_in));
+    for (int pc = 0; pc < MEMORY_SIZE; pc++) {
+        uint64_t since = hits[pc] - p->pc_counted[pc];
+        if (since == 0) continue;
+        // what ran, like type_at: the memory can be written already while it is settled
+        const Chip8_Decoded *d = &chip8->decoded[pc >> 1];
+        bool decoded = (pc & 1) == 0 && d->handler;
+        Op_Type type = decoded ? (Op_Type) (d->handler - 1) : op_decode(chip8_op_at(chip8, pc));
+        uint16_t nnn = decoded ? d->nnn : chip8_op_at(chip8, pc) & 0x0FFF;
+        if (type == OP_JP_ADDR || type == OP_CALL) jumps_in[nnn] += since;
+        if (type == OP_CALL && pc + 2 < MEMORY_SIZE) jumps_in[pc + 2] += since;
+    }
+    for (int i = 0; i < chip8->sp; i++) jumps_in[chip8->stack[i] & (MEMORY_SIZE - 1)]--;
+}
+
+// Adds the skips since they were last settled: pc + 2 is only reached by a skip at pc not
+// taken, a skip at pc - 2 taken, or a jump. All of it is counted from the settled point on,
+// the differences are exact whatever the counters went through
+static void skips_since(const Chip8 *chip8, const uint64_t *hits, const uint64_t *jumps_in,
+                        uint64_t *taken, uint64_t *not_taken) {
+    const Chip8_Profile *p = chip8->profile;
+    for (int start = 0; start < 2; start++) {
+        uint64_t landed = 0;
+        for (int pc = start; pc < MEMORY_SIZE; pc += 2) {
+            Op_Type type = type_at(chip8, pc);
+            uint64_t ran = hits[pc] - p->settled_hits[pc];
+            if (!is_skip(type) || ran == 0) {
+                landed = 0;
+                continue;
+            }
+
+            uint64_t next = 0, other = landed;
+            if (pc + 2 < MEMORY_SIZE) {
+                // the instruction at chip8->pc was got to, it just did not run yet
+                next = hits[pc + 2] - p->settled_hits[pc + 2] +
+                       (chip8->pc == pc + 2) - (p->settled_pc == pc + 2);
+                other += jumps_in[pc + 2] - p->settled_jumps[pc + 2];
+            }
+            int64_t stayed = (int64_t) (next - other);
+            if (stayed < 0) stayed = 0;
+            if ((uint64_t) stayed > ran) stayed = ran;
+            not_taken[type] += stayed;
+            taken[type] += ran - stayed;
+            landed = ran - stayed;
+        }
+    }
+}
+
+// The skips so far are counted as the code that ran them, before it changes
+static void settle_skips(Chip8 *chip8) {
+    Chip8_Profile *p = chip8->profile;
+    uint64_t hits[MEMORY_SIZE], jumps_in[MEMORY_SIZE];
+    chip8_profile_hits(chip8, hits);
+    jumps_into(chip8, hits, jumps_in);
+    skips_since(chip8, hits, jumps_in, p->skips_taken, p->skips_not_taken);
+    memcpy(p->settled_hits, hits, sizeof(hits));
+    memcpy(p->settled_jumps, jumps_in, sizeof(jumps_in));
+    p->settled_pc = chip8->pc;
+}
+
+void chip8_profile_skips(const Chip8 *chip8, uint64_t *taken, uint64_t *not_taken) {
+    memset(taken, 0, __OP_CNT__*sizeof(*taken));
+    memset(not_taken, 0, __OP_CNT__*sizeof(*not_taken));
+    const Chip8_Profile *p = chip8->profile;
+    if (p == NULL) return;
+
+    memcpy(taken, p->skips_taken, sizeof(p->skips_taken));
+    memcpy(not_taken, p->skips_not_taken, sizeof(p->skips_not_taken));
+    uint64_t hits[MEMORY_SIZE], jumps_in[MEMORY_SIZE];
+    chip8_profile_hits(chip8, hits);
+    jumps_into(chip8, hits, jumps_in);
+    skips_since(chip8, hits, jumps_in, taken, not_taken);
+}
+
+void chip8_profile_invalidate(Chip8 *chip8, uint16_t first, uint16_t last) {
+    // a skip that ran is going away, or one is turning up where something else ran
+    for (int pc = first; pc <= last; pc += 2) {
+        uint8_t handler = chip8->decoded[pc >> 1].handler;
+        if (handler && (is_skip(handler - 1) || is_skip(op_decode(chip8_op_at(chip8, pc))))) {
+            settle_skips(chip8);
+            break;
+        }
+    }
+
+    // the hits so far are counted as the instructions there now, and so is what they went
+    // on to: the new code at pc - 2 only passes on the hits it gets itself
+    Chip8_Profile *p = chip8->profile;
+    for (int pc = first; pc <= last; pc += 2) {
+        uint8_t handler = chip8->decoded[pc >> 1].handler;
+        if (handler == 0) continue;
+
+        uint64_t hits = chip8_profile_hits_at(chip8, pc);
+        uint64_t since = hits - p->pc_counted[pc];
+        p->ops[handler - 1] += since;
+        if (goes_on(handler - 1)) p->flowed[pc] += since;
+        // and where the jumps went, see chip8_profile_skips
+        uint16_t nnn = chip8->decoded[pc >> 1].nnn;
+        if (handler - 1 == OP_JP_ADDR || handler - 1 == OP_CALL) p->dynamic_jumps[nnn] += since;
+        if (handler - 1 == OP_CALL && pc + 2 < MEMORY_SIZE) p->dynamic_jumps[pc + 2] += since;
+        p->pc_counted[pc] = hits;
+    }
+}
+
+void chip8_profile_write_json(const Chip8 *chip8, FILE *file) {
+    const Chip8_Profile *p = chip8->profile;
+    if (p == NULL) return;
+
+    uint64_t ops[__OP_CNT__ + 1];
+    chip8_profile_ops(chip8, ops);
+    uint64_t total = 0;
+    for (int type = 0; type <= __OP_CNT__; type++) total += ops[type];
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"instructions\": %llu,\n", (unsigned long long) total);
+
+    fprintf(file, "  \"ops\": {");
+    const char *sep = "";
+    for (int type = 0; type <= __OP_CNT__; type++) {
+        if (ops[type] == 0) continue;
+        fprintf(file, "%s\n    \"%s\": %llu", sep, type_name(type), (unsigned long long) ops[type]);
+        sep = ",";
+    }
+    fprintf(file, "\n  },\n");
+
+    uint64_t taken[__OP_CNT__], not_taken[__OP_CNT__];
+    chip8_profile_skips(chip8, taken, not_taken);
+    fprintf(file, "  \"skips\": {");
+    sep = "";
+    for (int type = 0; type < __OP_CNT__; type++) {
+        if (!is_skip(type) || taken[type] + not_taken[type] == 0) continue;
+        fprintf(file, "%s\n    \"%s\": {\"taken\": %llu, \"not_taken\": %llu}", sep, type_name(type),
+                (unsigned long long) taken[type], (unsigned long long) not_taken[type]);
+        sep = ",";
+    }
+    fprintf(file, "\n  },\n");
+
+    uint64_t draws = ops[OP_DRW];
+    fprintf(file, "  \"draws\": {\"count\": %llu, \"collisions\": %llu, \"collision_rate\": %.4f},\n",
+            (unsigned long long) draws, (unsigned long long) p->draw_collisions,
+            draws ? (double) p->draw_collisions/draws : 0.0);
+
+    uint64_t hits[MEMORY_SIZE];
+    chip8_profile_hits(chip8, hits);
+    fprintf(file, "  \"pcs\": [");
+    sep = "";
+    for (int pc = 0; pc < MEMORY_SIZE; pc++) {
+        if (hits[pc] == 0) continue;
+        fprintf(file, "%s\n    {\"pc\": \"0x%04x\", \"op\": \"%s\", \"hits\": %llu}", sep, pc,
+                type_name(op_decode(chip8_op_at(chip8, pc))), (unsigned long long) hits[pc]);
+        sep = ",";
+    }
+    fprintf(file, "\n  ]\n");
+    fprintf(file, "}\n");
+}
+
+void chip8_profile_write_folded(const Chip8 *chip8, const char *root, FILE *file) {
+    if (chip8->profile == NULL) return;
+
+    uint64_t hits[MEMORY_SIZE];
+    chip8_profile_hits(chip8, hits);
+    for (int pc = 0; pc < MEMORY_SIZE; pc++) {
+        if (hits[pc] == 0) continue;
+        fprintf(file, "%s;%s;0x%04x %llu\n", root, type_name(op_decode(chip8_op_at(chip8, pc))), pc,
+                (unsigned long long) hits[pc]);
+    }
+}
+
+#else
+
+bool chip8_profile_enable(Chip8 *chip8) {
+    (void) chip8;
+    return false;
+}
+
+void chip8_profile_disable(Chip8 *chip8) {
+    (void) chip8;
+}
+
+void chip8_profile_write_json(const Chip8 *chip8, FILE *file) {
+    (void) chip8;
+    (void) file;
+}
+
+void chip8_profile_ops(const Chip8 *chip8, uint64_t *ops) {
+    (void) chip8;
+    memset(ops, 0, (__OP_CNT__ + 1)*sizeof(*ops));
+}
+
+void chip8_profile_hits(const Chip8 *chip8, uint64_t *hits) {
+    (void) chip8;
+    memset(hits, 0, MEMORY_SIZE*sizeof(*hits));
+}
+
+uint64_t chip8_profile_hits_at(const Chip8 *chip8, uint16_t pc) {
+    (void) chip8;
+    (void) pc;
+    return 0;
+}
+
+void chip8_profile_invalidate(Chip8 *chip8, uint16_t first, uint16_t last) {
+    (void) chip8;
+    (void) first;
+    (void) last;
+}
+
+void chip8_profile_leave(Chip8 *chip8) {
+    (void) chip8;
+}
+
+void chip8_profile_arrive(Chip8 *chip8) {
+    (void) chip8;
+}
+
+void chip8_profile_skips(const Chip8 *chip8, uint64_t *taken, uint64_t *not_taken) {
+    (void) chip8;
+    memset(taken, 0, __OP_CNT__*sizeof(*taken));
+    memset(not_taken, 0, __OP_CNT__*sizeof(*not_taken));
+}
+
+void chip8_profile_write_folded(const Chip8 *chip8, const char *root, FILE *file) {
+    (void) chip8;
+    (void) root;
+    (void) file;
+}
+
+#endif // PROFILE
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
@@ -0,0 +1,235 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "chip8_rewind.h"
+
+#define BLOCK 64
+#define BLOCK_CNT ((int) ((CHIP8_STATE_SIZE + BLOCK - 1)/BLOCK))
+#define MASK_WORDS ((BLOCK_CNT + 63)/64)
+// the state rounded up to whole blocks, the tail is always zero
+#define PADDED_SIZE (BLOCK_CNT*BLOCK)
+// a block is (zeros, literals, bytes...) runs: at worst a run per two bytes
+#define MAX_BLOCK_RLE (2*(BLOCK/2 + 1) + BLOCK)
+#define MAX_DELTA (MASK_WORDS*sizeof(uint64_t) + BLOCK_CNT*MAX_BLOCK_RLE)
+
+typedef struct {
+    size_t offset;
+    uint32_t size;
+    bool keyframe;
+} Snapshot;
+
+struct Chip8_Rewind {
+    uint8_t *data;
+    size_t data_size;
+    // where the next snapshot goes
+    size_t tail;
+
+    // ring of snapshots, oldest at head
+    Snapshot *snapshots;
+    int capacity;
+    int head;
+    int count;
+
+    int keyframe_every;
+    // deltas pushed since the newest keyframe
+    int since_keyframe;
+
+    // state of the newest snapshot, what the next delta is taken against
+    uint8_t last[PADDED_SIZE];
+    uint8_t scratch[MAX_DELTA > PADDED_SIZE ? MAX_DELTA : PADDED_SIZE];
+};
+
+Chip8_Rewind *chip8_rewind_create(size_t bytes, int frames, int keyframe_every) {
+    if (bytes < 2*PADDED_SIZE + MAX_DELTA || frames < 1 || keyframe_every < 1) return NULL;
+
+    Chip8_Rewind *rewind = calloc(1, sizeof(*rewind));
+    if (rewind == NULL) return NULL;
+
+    rewind->data = malloc(bytes);
+    rewind->snapshots = calloc(frames, sizeof(Snapshot));
+    if (rewind->data == NULL || rewind->snapshots == NULL) {
+        chip8_rewind_destroy(rewind);
+        return NULL;
+    }
+
+    rewind->data_size = bytes;
+    rewind->capacity = frames;
+    rewind->keyframe_every = keyframe_every;
+    return rewind;
+}
+
+void chip8_rewind_destroy(Chip8_Rewind *rewind) {
+    if (rewind == NULL) return;
+    free(rewind->data);
+    free(rewind->snapshots);
+    free(rewind);
+}
+
+static Snapshot *snapshot_at(Chip8_Rewind *rewind, int i) {
+    return &rewind->snapshots[(rewind->head + i) % rewind->capacity];
+}
+
+// Drops the oldest keyframe and the deltas that depend on it
+static void drop_oldest(Chip8_Rewind *rewind) {
+    do {
+        rewind->head = (rewind->head + 1) % rewind->capacity;
+        rewind->count--;
+    } while (rewind->count > 0 && !snapshot_at(rewind, 0)->keyframe);
+
+    if (rewind->count == 0) rewind->tail = 0;
+}
+
+static size_t encode_block(const uint8_t *x, uint8_t *out) {
+    size_t n = 0;
+    int i = 0;
+    while (i < BLOCK) {
+        int zeros = 0, literals = 0;
+        while (i < BLOCK && x[i] == 0) zeros++, i++;
+        int start = i;
+        while (i < BLOCK && x[i] != 0) literals++, i++;
+
+        out[n++] = zeros;
+        out[n++] = literals;
+        memcpy(out + n, x + start, literals);
+        n += literals;
+    }
+
+    return n;
+}
+
+// XORs an encoded block into state, returns the bytes of input it used
+static size_t apply_block(uint8_t *state, const uint8_t *in) {
+    size_t n = 0;
+    int i = 0;
+    while (i < BLOCK) {
+        i += in[n++];
+        int literals = in[n++];
+        for (int k = 0; k < literals; k++) state[i + k] ^= in[n + k];
+        i += literals;
+        n += literals;
+    }
+
+    return n;
+}
+
+static size_t encode_delta(const uint8_t *prev, const uint8_t *cur, uint8_t *out) {
+    uint64_t mask[MASK_WORDS] = {0};
+    size_t n = sizeof(mask);
+    for (int b = 0; b < BLOCK_CNT; b++) {
+        const uint8_t *p = prev + b*BLOCK, *c = cur + b*BLOCK;
+        if (memcmp(p, c, BLOCK) == 0) continue;
+
+        uint8_t x[BLOCK];
+        for (int i = 0; i < BLOCK; i++) x[i] = p[i] ^ c[i];
+        mask[b/64] |= (uint64_t) 1 << (b%64);
+        n += encode_block(x, out + n);
+    }
+
+    memcpy(out, mask, sizeof(mask));
+    return n;
+}
+
+static void apply_delta(uint8_t *state, const uint8_t *in) {
+    uint64_t mask[MASK_WORDS];
+    memcpy(mask, in, sizeof(mask));
+    size_t n = sizeof(mask);
+    for (int b = 0; b < BLOCK_CNT; b++) {
+        if (mask[b/64] & ((uint64_t) 1 << (b%64))) {
+            n += apply_block(state + b*BLOCK, in + n);
+        }
+    }
+}
+
+void chip8_rewind_push(Chip8_Rewind *rewind, const Chip8 *chip8) {
+    uint8_t cur[PADDED_SIZE] = {0};
+    chip8_save_state(chip8, (Chip8_State *) cur);
+
+    bool keyframe = rewind->count == 0 || rewind->since_keyframe + 1 >= rewind->keyframe_every;
+    size_t size = keyframe ? PADDED_SIZE : encode_delta(rewind->last, cur, rewind->scratch);
+    if (rewind->count == rewind->capacity) drop_oldest(rewind);
+
+    for (;;) {
+        if (rewind->tail + size > rewind->data_size) {
+            // whatever is past the tail is older than what is at the start
+            while (rewind->count > 0 && snapshot_at(rewind, 0)->offset >= rewind->tail) drop_oldest(rewind);
+            rewind->tail = 0;
+        }
+
+        // make room, the oldest snapshots are the ones right after the tail
+        while (rewind->count > 0) {
+            Snapshot *oldest = snapshot_at(rewind, 0);
+            if (oldest->offset >= rewind->tail + size || rewind->tail >= oldest->offset + oldest->size) break;
+            drop_oldest(rewind);
+        }
+
+        // a delta with nothing left to apply it to becomes a keyframe
+        if (keyframe || rewind->count > 0) break;
+        keyframe = true;
+        size = PADDED_SIZE;
+    }
+
+    if (keyframe) {
+        memcpy(rewind->data + rewind->tail, cur, PADDED_SIZE);
+        rewind->since_keyframe = 0;
+    } else {
+        memcpy(rewind->data + rewind->tail, rewind->scratch, size);
+        rewind->since_keyframe++;
+    }
+
+    Snapshot *s = &rewind->snapshots[(rewind->head + rewind->count) % rewind->capacity];
+    *s = (Snapshot) { .offset = rewind->tail, .size = size, .keyframe = keyframe };
+    rewind->count++;
+    rewind->tail += size;
+    memcpy(rewind->last, cur, PADDED_SIZE);
+}
+
+bool chip8_rewind_restore(Chip8_Rewind *rewind, int back, Chip8 *chip8) {
+    if (back < 0 || back >= rewind->count) return false;
+
+    int target = rewind->count - 1 - back;
+    int key = target;
+    // the oldest snapshot is always a keyframe
+    while (!snapshot_at(rewind, key)->keyframe) key--;
+
+    uint8_t *state = rewind->scratch;
+    memcpy(state, rewind->data + snapshot_at(rewind, key)->offset, PADDED_SIZE);
+    for (int i = key + 1; i <= target; i++) {
+        apply_delta(state, rewind->data + snapshot_at(rewind, i)->offset);
+    }
+
+    chip8_load_state(chip8, (const Chip8_State *) state);
+
+    Snapshot *s = snapshot_at(rewind, target);
+    rewind->count = target + 1;
+    rewind->tail = s->offset + s->size;
+    rewind->since_keyframe = target - key;
+    memcpy(rewind->last, state, PADDED_SIZE);
+    return true;
+}
+
+int chip8_rewind_count(const Chip8_Rewind *rewind) {
+    return rewind->count;
+}
+
+size_t chip8_rewind_used(const Chip8_Rewind *rewind) {
+    size_t used = 0;
+    for (int i = 0; i < rewind->count; i++) {
+        used += rewind->snapshots[(rewind->head + i) % rewind->capacity].size;
+    }
+
+    return used;
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
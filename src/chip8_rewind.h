@@ -0,0 +1,33 @@
+#ifndef CHIP8_REWIND_H_
+#define CHIP8_REWIND_H_
+
+#include "chip8.h"
+
+// Ring buffer of snapshots for scrubbing back through a session, one per frame.
+// A snapshot only stores the 64 byte blocks of the state that changed since the
+// previous one (XORed with it and run-length encoded), and every keyframe_every
+// snapshots there is a full one, so a restore never replays more than that many
+// deltas. When the buffer is full the oldest keyframe and its deltas are dropped.
+//
+//     Chip8_Rewind *rewind = chip8_rewind_create(4 << 20, 60*60, 60);
+//     ... every frame: chip8_rewind_push(rewind, &chip8);
+//     ... to go one frame back: chip8_rewind_restore(rewind, 1, &chip8);
+
+typedef struct Chip8_Rewind Chip8_Rewind;
+
+// bytes is the size of the snapshot buffer, frames the most snapshots kept.
+// Returns NULL when out of memory or when bytes can't hold two keyframes
+Chip8_Rewind *chip8_rewind_create(size_t bytes, int frames, int keyframe_every);
+void chip8_rewind_destroy(Chip8_Rewind *rewind);
+
+void chip8_rewind_push(Chip8_Rewind *rewind, const Chip8 *chip8);
+// Puts chip8 back to the snapshot pushed `back` pushes ago (0 is the last one) and
+// drops the ones after it, so the next push continues from there. Returns false,
+// leaving everything alone, when there are not that many snapshots
+bool chip8_rewind_restore(Chip8_Rewind *rewind, int back, Chip8 *chip8);
+
+// Snapshots held, and the bytes of the buffer they take
+int chip8_rewind_count(const Chip8_Rewind *rewind);
+size_t chip8_rewind_used(const Chip8_Rewind *rewind);
+
+#endif // CHIP8_REWIND_H_
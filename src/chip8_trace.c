@@ -0,0 +1,142 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#include "chip8.h"
+
+// Execution trace: the records are written by the interpreter (TRACE in
+// chip8_interpret), this is the setup and the file.
+//
+// The file is a header followed by the records, oldest first, and one more record
+// with the state after the newest one (its op is the one about to run):
+//     magic "C8TR", version, records in the file - 1, records written in total
+//     cycle (8), pc (2), op (2), I (2), sp (1), 0 (1), V0..VF (16)
+// All numbers are little-endian.
+
+#define MAGIC "C8TR"
+#define VERSION 1
+#define HEADER_SIZE (4 + 1 + 8 + 8)
+#define RECORD_SIZE 32
+
+#if defined(DEBUG)
+
+bool chip8_trace_enable(Chip8 *chip8, size_t records) {
+    if (chip8->trace) return true;
+
+    size_t capacity = 1;
+    while (capacity < records) capacity <<= 1;
+
+    Chip8_Trace *trace = calloc(1, sizeof(*trace));
+    if (trace == NULL) return false;
+
+    trace->records = malloc(capacity*sizeof(*trace->records));
+    if (trace->records == NULL) {
+        free(trace);
+        return false;
+    }
+
+    trace->mask = capacity - 1;
+    chip8->trace = trace;
+    return true;
+}
+
+void chip8_trace_disable(Chip8 *chip8) {
+    if (chip8->trace == NULL) return;
+    free(chip8->trace->records);
+    free(chip8->trace);
+    chip8->trace = NULL;
+}
+
+static uint8_t *put(uint8_t *p, uint64_t v, int bytes) {
+    for (int i = 0; i < bytes; i++) *p++ = v >> (8*i);
+    return p;
+}
+
+static bool write_record(const Chip8_Trace_Record *r, FILE *file) {
+    uint8_t bytes[RECORD_SIZE];
+    uint8_t *p = bytes;
+    p = put(p, r->cycle, 8);
+    p = put(p, r->pc, 2);
+    p = put(p, r->op, 2);
+    p = put(p, r->regi, 2);
+    *p++ = r->sp;
+    *p++ = 0;
+    memcpy(p, r->regs, sizeof(r->regs));
+    return fwrite(bytes, 1, sizeof(bytes), file) == sizeof(bytes);
+}
+
+Chip8_Status chip8_trace_write(const Chip8 *chip8, const char *path) {
+    const Chip8_Trace *trace = chip8->trace;
+    if (trace == NULL) return CHIP8_OK;
+
+    uint64_t capacity = trace->mask + 1;
+    uint64_t count = trace->count < capacity ? trace->count : capacity;
+
+    uint8_t header[HEADER_SIZE];
+    memcpy(header, MAGIC, 4);
+    header[4] = VERSION;
+    put(put(header + 5, count, 8), trace->count, 8);
+
+    Chip8_Trace_Record now = {
+        .cycle = trace->cycle,
+        .pc = chip8->pc,
+        .op = chip8->pc <= MEMORY_SIZE - 2 ? chip8_op_at(chip8, chip8->pc) : 0,
+        .regi = chip8->regi,
+        .sp = chip8->sp,
+    };
+    memcpy(now.regs, chip8->regs, sizeof(now.regs));
+
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        return CHIP8_ERR_TRACE_OPEN;
+    }
+
+    bool ok = fwrite(header, 1, sizeof(header), file) == sizeof(header);
+    for (uint64_t i = trace->count - count; ok && i < trace->count; i++) {
+        ok = write_record(&trace->records[i & trace->mask], file);
+    }
+    ok = ok && write_record(&now, file);
+
+    if (fclose(file) != 0) ok = false;
+    if (!ok) {
+        fprintf(stderr, "ERROR: could not write trace %s: %s\n", path, strerror(errno));
+        return CHIP8_ERR_TRACE_OPEN;
+    }
+
+    return CHIP8_OK;
+}
+
+#else
+
+bool chip8_trace_enable(Chip8 *chip8, size_t records) {
+    (void) chip8;
+    (void) records;
+    return false;
+}
+
+void chip8_trace_disable(Chip8 *chip8) {
+    (void) chip8;
+}
+
+Chip8_Status chip8_trace_write(const Chip8 *chip8, const char *path) {
+    (void) chip8;
+    (void) path;
+    return CHIP8_OK;
+}
+
+#endif // DEBUG
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
@@ -0,0 +1,329 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+
+#include "chip8.h"
+#include "chip8_batch.h"
+
+// Conformance runner for the test roms: runs every rom listed in the golden file
+// headless, in parallel, for TEST_FRAMES frames of TEST_IPF instructions, pressing
+// the scripted keys, and compares the hash of the final screen with the golden one.
+//
+//     ./bin/conformance [-v] [-jit] [-threads N] [DIR]
+//
+// DIR defaults to tests and holds the roms and golden.txt, one rom per line:
+//     # rom              frame_hash        [quirks=NAME] keys
+//     6-keypad.ch8       0123456789abcdef  3@10-12 A@30-31
+//     5-quirks.ch8       0123456789abcdef  quirks=schip 2@5-6
+// where K@FIRST-LAST holds key K (hex) from frame FIRST to frame LAST, and quirks=NAME
+// runs the rom under another quirk profile than chip8 (see Chip8_Quirks). A golden
+// must only be changed after checking the screen by eye (-v prints them).
+// After the roms, a state saved under one profile is loaded into a machine on another.
+
+#define TEST_FRAMES 600
+#define TEST_IPF 1000
+#define TEST_SEED 0
+#define MAX_TESTS 64
+#define MAX_PRESSES 16
+
+typedef struct {
+    uint8_t key;
+    uint32_t first, last;
+} Press;
+
+typedef struct {
+    char rom[256];
+    uint64_t frame_hash;
+    Chip8_Quirks quirks;
+    Press presses[MAX_PRESSES];
+    int press_cnt;
+} Test;
+
+static Test tests[MAX_TESTS];
+static size_t test_cnt = 0;
+
+static double now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec*1e9 + ts.tv_nsec;
+}
+
+static uint16_t scripted_input(size_t instance, uint32_t frame, void *user) {
+    (void) user;
+    const Test *test = &tests[instance];
+    uint16_t keyboard = 0;
+    for (int i = 0; i < test->press_cnt; i++) {
+        const Press *p = &test->presses[i];
+        if (frame >= p->first && frame <= p->last) keyboard |= chip8_key_masks[p->key];
+    }
+
+    return keyboard;
+}
+
+static bool parse_press(const char *s, Press *press) {
+    char key[2];
+    unsigned first, last;
+    if (sscanf(s, "%1[0-9a-fA-F]@%u-%u", key, &first, &last) != 3 || first > last) return false;
+
+    press->key = strtol(key, NULL, 16);
+    press->first = first;
+    press->last = last;
+    return true;
+}
+
+static bool load_golden(const char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        return false;
+    }
+
+    bool ok = true;
+    char line[1024];
+    for (int line_no = 1; fgets(line, sizeof(line), file); line_no++) {
+        char *comment = strchr(line, '#');
+        if (comment) *comment = '\0';
+
+        char *word = strtok(line, " \t\r\n");
+        if (word == NULL) continue;
+
+        if (test_cnt == MAX_TESTS) {
+            fprintf(stderr, "ERROR: %s:%d: more than %d tests\n", path, line_no, MAX_TESTS);
+            ok = false;
+            break;
+        }
+
+        Test *test = &tests[test_cnt];
+        snprintf(test->rom, sizeof(test->rom), "%s", word);
+
+        char *hash = strtok(NULL, " \t\r\n");
+        char *end;
+        test->frame_hash = hash ? strtoull(hash, &end, 16) : 0;
+        if (hash == NULL || *end != '\0') {
+            fprintf(stderr, "ERROR: %s:%d: expected `rom frame_hash [quirks=NAME] [keys]`\n", path, line_no);
+            ok = false;
+            break;
+        }
+
+        while ((word = strtok(NULL, " \t\r\n")) != NULL) {
+            if (strncmp(word, "quirks=", 7) == 0) {
+                test->quirks = chip8_quirks_find(word + 7);
+                if (test->quirks == __CHIP8_QUIRKS_CNT__) {
+                    fprintf(stderr, "ERROR: %s:%d: unknown quirk profile `%s`\n", path, line_no, word + 7);
+                    ok = false;
+                    break;
+                }
+                continue;
+            }
+            if (test->press_cnt == MAX_PRESSES || !parse_press(word, &test->presses[test->press_cnt])) {
+                fprintf(stderr, "ERROR: %s:%d: invalid key press `%s`, expected K@FIRST-LAST\n", path, line_no, word);
+                ok = false;
+                break;
+            }
+            test->press_cnt++;
+        }
+
+        if (!ok) break;
+        test_cnt++;
+    }
+
+    fclose(file);
+    return ok;
+}
+
+static void print_frame_buffer(const Chip8 *chip8) {
+    for (int y = 0; y < SCREEN_H(chip8->hires); y++) {
+        for (int x = 0; x < SCREEN_W(chip8->hires); x++) {
+            putchar(is_pixel_active(chip8, x, y) ? '#' : '.');
+        }
+        putchar('\n');
+    }
+}
+
+static Chip8_Status run_frames(Chip8 *chip8, uint32_t frames) {
+    for (uint32_t frame = 0; frame < frames; frame++) {
+        Chip8_Status status = chip8_run_cycles(chip8, chip8->cycles);
+        if (status != CHIP8_OK) return status;
+        chip8_tick_frame(chip8);
+    }
+    return CHIP8_OK;
+}
+
+// A state saved under schip and loaded into a chip8 machine with the JIT on: the quirks
+// come with the state, and the blocks the JIT made under the chip8 ones must not run.
+// 5-quirks.ch8 with the platform preselected (0x1FF) goes straight to its checks
+static bool check_state_quirks(const char *dir, bool verbose) {
+    static Chip8 schip, jit;
+    static Chip8_State state;
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/5-quirks.ch8", dir);
+    chip8_init(&schip);
+    chip8_init(&jit);
+    if (chip8_load_rom(&schip, path) != CHIP8_OK || chip8_load_rom(&jit, path) != CHIP8_OK) return false;
+    if (!chip8_jit_enable(&jit)) {
+        printf("SKIP state across profiles: the JIT is not supported on this host\n");
+        return true;
+    }
+
+    Chip8 *machines[] = {&schip, &jit};
+    for (int i = 0; i < 2; i++) {
+        machines[i]->memory[0x1FF] = 2;
+        machines[i]->ipf = TEST_IPF;
+        machines[i]->cycles = TEST_IPF;
+        chip8_seed(machines[i], TEST_SEED);
+    }
+    chip8_set_quirks(&schip, CHIP8_QUIRKS_SCHIP);
+    chip8_set_quirks(&jit, CHIP8_QUIRKS_CHIP8);
+
+    // the JIT machine runs the checks once under chip8, then takes the schip state
+    Chip8_Status status = run_frames(&jit, TEST_FRAMES);
+    chip8_save_state(&schip, &state);
+    chip8_load_state(&jit, &state);
+    if (status == CHIP8_OK) status = run_frames(&schip, TEST_FRAMES);
+    if (status == CHIP8_OK) status = run_frames(&jit, TEST_FRAMES);
+    if (verbose) print_frame_buffer(&jit);
+
+    Chip8_State expected;
+    chip8_save_state(&schip, &expected);
+    chip8_save_state(&jit, &state);
+    chip8_jit_disable(&jit);
+    if (status != CHIP8_OK) {
+        printf("FAIL state across profiles: %s\n", chip8_status_name(status));
+        return false;
+    }
+    if (memcmp(expected.bytes, state.bytes, CHIP8_STATE_SIZE) != 0) {
+        printf("FAIL state across profiles: the JIT machine did not end up like the schip one\n");
+        return false;
+    }
+
+    printf("PASS state across profiles\n");
+    return true;
+}
+
+char *shift(int *argc, char ***argv) {
+    return (*argc)--, *(*argv)++;
+}
+
+void usage(const char *program_name) {
+    fprintf(stderr, "    usage: %s [OPTIONS] [DIR]\n", program_name);
+    fprintf(stderr, "    OPTIONS:\n");
+    fprintf(stderr, "        -v             print the final screen of every rom\n");
+    fprintf(stderr, "        -jit           use the x86-64 recompiler\n");
+    fprintf(stderr, "        -threads <N>   worker threads (default one per cpu)\n");
+    fprintf(stderr, "    DIR holds the roms and golden.txt (default tests)\n");
+}
+
+int main(int argc, char **argv) {
+    char *program_name = shift(&argc, &argv);
+    const char *dir = "tests";
+    bool verbose = false;
+    bool use_jit = false;
+    int threads = 0;
+    while (argc > 0) {
+        char *arg = shift(&argc, &argv);
+        if (strcmp(arg, "-v") == 0) {
+            verbose = true;
+        } else if (strcmp(arg, "-jit") == 0) {
+            use_jit = true;
+        } else if (strcmp(arg, "-threads") == 0) {
+            if (argc == 0) {
+                fprintf(stderr, "ERROR: %s expects a value\n", arg);
+                usage(program_name);
+                return 1;
+            }
+            threads = atoi(shift(&argc, &argv));
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "ERROR: unknown option %s\n", arg);
+            usage(program_name);
+            return 1;
+        } else {
+            dir = arg;
+        }
+    }
+
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/golden.txt", dir);
+    if (!load_golden(path)) return 1;
+    if (test_cnt == 0) {
+        fprintf(stderr, "ERROR: no tests in %s\n", path);
+        return 1;
+    }
+
+    Chip8_Batch batch;
+    if (!chip8_batch_init(&batch, test_cnt)) {
+        fprintf(stderr, "ERROR: could not allocate %zu machines\n", test_cnt);
+        return 1;
+    }
+
+    double start = now_ns();
+    for (size_t i = 0; i < test_cnt; i++) {
+        Chip8 *chip8 = &batch.machines[i];
+        if (snprintf(path, sizeof(path), "%s/%s", dir, tests[i].rom) >= (int) sizeof(path)) {
+            fprintf(stderr, "ERROR: path of %s is too long\n", tests[i].rom);
+            chip8_batch_free(&batch);
+            return 1;
+        }
+
+        if (chip8_load_rom(chip8, path) != CHIP8_OK) {
+            chip8_batch_free(&batch);
+            return 1;
+        }
+
+        chip8->ipf = TEST_IPF;
+        chip8->cycles = TEST_IPF;
+        chip8_seed(chip8, TEST_SEED);
+        chip8_set_quirks(chip8, tests[i].quirks);
+        if (use_jit && !chip8_jit_enable(chip8)) {
+            fprintf(stderr, "ERROR: the JIT is not supported on this host\n");
+            chip8_batch_free(&batch);
+            return 1;
+        }
+    }
+
+    chip8_batch_run(&batch, threads, TEST_FRAMES, scripted_input, NULL);
+    double ms = (now_ns() - start)*1e-6;
+
+    size_t failed = 0;
+    for (size_t i = 0; i < test_cnt; i++) {
+        const Test *test = &tests[i];
+        const Chip8_Result *r = &batch.results[i];
+        char profile[32] = "";
+        if (test->quirks != CHIP8_QUIRKS_CHIP8) snprintf(profile, sizeof(profile), " (%s)", chip8_quirk_sets[test->quirks].name);
+        if (verbose) print_frame_buffer(&batch.machines[i]);
+
+        if (r->status != CHIP8_OK) {
+            printf("FAIL %s%s: %s at 0x%04x in frame %u\n", test->rom, profile, chip8_status_name(r->status), r->pc, r->frames);
+            failed++;
+        } else if (r->frame_hash != test->frame_hash) {
+            printf("FAIL %s%s: frame hash %016llx, expected %016llx\n", test->rom, profile,
+                   (unsigned long long) r->frame_hash, (unsigned long long) test->frame_hash);
+            failed++;
+        } else {
+            printf("PASS %s%s\n", test->rom, profile);
+        }
+    }
+
+    chip8_batch_free(&batch);
+
+    size_t total = test_cnt + 1;
+    if (!check_state_quirks(dir, verbose)) failed++;
+    printf("%zu passed, %zu failed in %.1fms\n", total - failed, failed, ms);
+    return failed ? 1 : 0;
+}
+
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
@@ -1,947 +1,891 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <string.h>
 #include <stdlib.h>
 #include <stdbool.h>
-#include <errno.h>
 #include <stdint.h>
-#include <assert.h>
+#include <limits.h>
 #include <math.h>
 #include <time.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
 #include <raylib.h>
 
-#define ASSERT assert
+#include "chip8.h"
+#include "chip8_rewind.h"
+#include "chip8_input.h"
+#include "chip8_audio.h"
+#include "chip8_clock.h"
+#include "chip8_display.h"
+
 // each pixel in the frame buffer will map to WINDOW_FACTOR in the pc
 // running the emulator
 #define WINDOW_FACTOR 10
-#define CYCLES_PER_SEC 8
-
-#define TODO(msg) ASSERT(0 && msg)
-
-// http://devernay.free.fr/hacks/chip8/C8TECH10.HTM
-// 3.1 - Standard Chip-8 Instructions
-// 00E0 - CLS
-// 00EE - RET
-// 0nnn - SYS addr
-// 2nnn - CALL addr
-// 3xkk - SE Vx, byte
-// 5xy0 - SE Vx, Vy
-// 8xy1 - OR Vx, Vy
-// 8xy2 - AND Vx, Vy
-// 8xy3 - XOR Vx, Vy
-// 8xy5 - SUB Vx, Vy
-// 8xy6 - SHR Vx {, Vy}
-// 8xy7 - SUBN Vx, Vy
-// 8xyE - SHL Vx {, Vy}
-// 4xkk - SNE Vx, byte
-// 9xy0 - SNE Vx, Vy
-// 1nnn - JP addr
-// Bnnn - JP V0, addr
-// Cxkk - RND Vx, byte
-// Dxyn - DRW Vx, Vy, nibble
-// Ex9E - SKP Vx
-// ExA1 - SKNP Vx
-// 7xkk - ADD Vx, byte
-// 8xy4 - ADD Vx, Vy
-// Fx1E - ADD I, Vx
-// 6xkk - LD Vx, byte
-// 8xy0 - LD Vx, Vy
-// Annn - LD I, addr
-// Fx07 - LD Vx, DT
-// Fx0A - LD Vx, K
-// Fx15 - LD DT, Vx
-// Fx18 - LD ST, Vx
-// Fx29 - LD F, Vx
-// Fx33 - LD B, Vx
-// Fx55 - LD [I], Vx
-// Fx65 - LD Vx, [I]
-
-typedef enum {
-    OP_CLS = 0    ,
-    OP_RET        ,
-    OP_SYS        ,
-    OP_CALL       ,
-    OP_SE_RB      ,
-    OP_SE_RR      ,
-    OP_OR         ,
-    OP_AND        ,
-    OP_XOR        ,
-    OP_SUB        ,
-    OP_SHR        ,
-    OP_SUBN       ,
-    OP_SHL        ,
-    OP_SNE_R_B    ,
-    OP_SNE_R_R    ,
-    OP_JP_ADDR    ,
-    OP_JP_V0_ADDR ,
-    OP_RND        ,
-    OP_DRW        ,
-    OP_SKP        ,
-    OP_SKNP       ,
-    OP_ADD_R_B    ,
-    OP_ADD_R_R    ,
-    OP_ADD_I_R    ,
-    OP_LD_R_B     ,
-    OP_LD_R_R     ,
-    OP_LD_I_ADDR  ,
-    OP_LD_R_DT    ,
-    OP_LD_R_K     ,
-    OP_LD_DT_R    ,
-    OP_LD_ST_R    ,
-    OP_LD_FONT_R  ,
-    OP_LD_BCD_R   ,
-    OP_LD_IMEM_R  ,
-    OP_LD_R_IMEM  ,
-    __OP_CNT__
-} Op_Type;
-
-typedef uint16_t Op;
 
-typedef struct {
-    uint16_t mask, value;
-} Op_Pattern;
-
-static Op_Pattern op_decode_table[__OP_CNT__] = {
-    [OP_CLS]         = { 0xFFFF, 0x00E0 },
-    [OP_RET]         = { 0xFFFF, 0x00EE },
-    [OP_SYS]         = { 0xF000, 0x0000 },
-    [OP_CALL]        = { 0xF000, 0x2000 },
-    [OP_SE_RB]       = { 0xF000, 0x3000 },
-    [OP_SE_RR]       = { 0xF000, 0x5000 },
-    [OP_OR]          = { 0xF00F, 0x8001 },
-    [OP_AND]         = { 0xF00F, 0x8002 },
-    [OP_XOR]         = { 0xF00F, 0x8003 },
-    [OP_SUB]         = { 0xF00F, 0x8005 },
-    [OP_SHR]         = { 0xF00F, 0x8006 },
-    [OP_SUBN]        = { 0xF00F, 0x8007 },
-    [OP_SHL]         = { 0xF00F, 0x800E },
-    [OP_SNE_R_B]     = { 0xF000, 0x4000 },
-    [OP_SNE_R_R]     = { 0xF00F, 0x9000 },
-    [OP_JP_ADDR]     = { 0xF000, 0x1000 },
-    [OP_JP_V0_ADDR]  = { 0xF000, 0xB000 },
-    [OP_RND]         = { 0xF000, 0xC000 },
-    [OP_DRW]         = { 0xF000, 0xD000 },
-    [OP_SKP]         = { 0xF0FF, 0xE09E },
-    [OP_SKNP]        = { 0xF0FF, 0xE0A1 },
-    [OP_ADD_R_B]     = { 0xF000, 0x7000 },
-    [OP_ADD_R_R]     = { 0xF00F, 0x8004 },
-    [OP_ADD_I_R]     = { 0xF0FF, 0xF01E },
-    [OP_LD_R_B]      = { 0xF000, 0x6000 },
-    [OP_LD_R_R]      = { 0xF00F, 0x8000 },
-    [OP_LD_I_ADDR]   = { 0xF000, 0xA000 },
-    [OP_LD_R_DT]     = { 0xF0FF, 0xF007 },
-    [OP_LD_R_K]      = { 0xF0FF, 0xF00A },
-    [OP_LD_DT_R]     = { 0xF0FF, 0xF015 },
-    [OP_LD_ST_R]     = { 0xF0FF, 0xF018 },
-    [OP_LD_FONT_R]   = { 0xF0FF, 0xF029 },
-    [OP_LD_BCD_R]    = { 0xF0FF, 0xF033 },
-    [OP_LD_IMEM_R]   = { 0xF0FF, 0xF055 },
-    [OP_LD_R_IMEM]   = { 0xF0FF, 0xF065 }
+static int keyboard_decode_table[0x10] = {
+    [0x1] = KEY_ONE   ,
+    [0x2] = KEY_TWO   ,
+    [0x3] = KEY_THREE ,
+    [0xC] = KEY_C     ,
+    [0x4] = KEY_FOUR  ,
+    [0x5] = KEY_FIVE  ,
+    [0x6] = KEY_SIX   ,
+    [0xD] = KEY_D     ,
+    [0x7] = KEY_SEVEN ,
+    [0x8] = KEY_EIGHT ,
+    [0x9] = KEY_NINE  ,
+    [0xE] = KEY_E     ,
+    [0xA] = KEY_A     ,
+    [0x0] = KEY_ZERO  ,
+    [0xB] = KEY_B     ,
+    [0xF] = KEY_F     ,
 };
 
-static char *op_names[__OP_CNT__] = {
-    [OP_CLS]         = "OP_CLS",
-    [OP_RET]         = "OP_RET",
-    [OP_SYS]         = "OP_SYS",
-    [OP_CALL]        = "OP_CALL",
-    [OP_SE_RB]       = "OP_SE_RB",
-    [OP_SE_RR]       = "OP_SE_RR",
-    [OP_OR]          = "OP_OR",
-    [OP_AND]         = "OP_AND",
-    [OP_XOR]         = "OP_XOR",
-    [OP_SUB]         = "OP_SUB",
-    [OP_SHR]         = "OP_SHR",
-    [OP_SUBN]        = "OP_SUBN",
-    [OP_SHL]         = "OP_SHL",
-    [OP_SNE_R_B]     = "OP_SNE_R_B",
-    [OP_SNE_R_R]     = "OP_SNE_R_R",
-    [OP_JP_ADDR]     = "OP_JP_ADDR",
-    [OP_JP_V0_ADDR]  = "OP_JP_V0_ADDR",
-    [OP_RND]         = "OP_RND",
-    [OP_DRW]         = "OP_DRW",
-    [OP_SKP]         = "OP_SKP",
-    [OP_SKNP]        = "OP_SKNP",
-    [OP_ADD_R_B]     = "OP_ADD_R_B",
-    [OP_ADD_R_R]     = "OP_ADD_R_R",
-    [OP_ADD_I_R]     = "OP_ADD_I_R",
-    [OP_LD_R_B]      = "OP_LD_R_B",
-    [OP_LD_R_R]      = "OP_LD_R_R",
-    [OP_LD_I_ADDR]   = "OP_LD_I_ADDR",
-    [OP_LD_R_DT]     = "OP_LD_R_DT",
-    [OP_LD_R_K]      = "OP_LD_R_K",
-    [OP_LD_DT_R]     = "OP_LD_DT_R",
-    [OP_LD_ST_R]     = "OP_LD_ST_R",
-    [OP_LD_FONT_R]   = "OP_LD_FONT_R",
-    [OP_LD_BCD_R]    = "OP_LD_BCD_R",
-    [OP_LD_IMEM_R]   = "OP_LD_IMEM_R",
-    [OP_LD_R_IMEM]   = "OP_LD_R_IMEM"
-};
+// The screen is a HIRES_W x HIRES_H texture of which the top left SCREEN_W x SCREEN_H
+// of the current resolution is drawn scaled up to the window, so presenting a frame is
+// one upload and one quad
+static uint32_t screen_pixels[HIRES_W*HIRES_H];
 
-// - The sound and delay timers sequentially decrease at a rate of 1 per tick of a 60Hz clock. When the
-// sound timer is above 0, the sound will play as a single monotone beep.
-
-// - The framebuffer is an (x, y) addressable memory array that designates whether a pixel is currently on
-// or off. This will be implemented with a write address, an (x, y) position, a offset in the x direction,
-// and an 8-bit group of pixels to be drawn to the screen.
-
-// - The return address stack stores previous program counters when jumping into a new routine.
-
-// - The VF register is frequently used for storing carry values from a subtraction or addition action, and
-// also specifies whether a particular pixel is to be drawn on the screen.
-
-#define MEMORY_SIZE 0x1000
-#define STACK_SIZE 0x10
-#define FRAME_W 64
-#define FRAME_H 32
-#define FRAME_BUFFER_SIZE FRAME_H*FRAME_W
-
-enum {
-    CHIP8_KEY_1 = 0b1000000000000000,
-    CHIP8_KEY_2 = 0b0100000000000000,
-    CHIP8_KEY_3 = 0b0010000000000000,
-    CHIP8_KEY_C = 0b0001000000000000,
-    CHIP8_KEY_4 = 0b0000100000000000,
-    CHIP8_KEY_5 = 0b0000010000000000,
-    CHIP8_KEY_6 = 0b0000001000000000,
-    CHIP8_KEY_D = 0b0000000100000000,
-    CHIP8_KEY_7 = 0b0000000010000000,
-    CHIP8_KEY_8 = 0b0000000001000000,
-    CHIP8_KEY_9 = 0b0000000000100000,
-    CHIP8_KEY_E = 0b0000000000010000,
-    CHIP8_KEY_A = 0b0000000000001000,
-    CHIP8_KEY_0 = 0b0000000000000100,
-    CHIP8_KEY_B = 0b0000000000000010,
-    CHIP8_KEY_F = 0b0000000000000001
-};
+uint32_t color_pixel(Color color) {
+    uint32_t pixel;
+    memcpy(&pixel, &color, sizeof(pixel));
+    return pixel;
+}
 
-static struct { uint16_t chip8; int raylib; }
-keyboard_decode_table[0x10] = {
-    [0x1] = { .chip8 = CHIP8_KEY_1 , .raylib = KEY_ONE    } ,
-    [0x2] = { .chip8 = CHIP8_KEY_2 , .raylib = KEY_TWO    } ,
-    [0x3] = { .chip8 = CHIP8_KEY_3 , .raylib = KEY_THREE  } ,
-    [0xC] = { .chip8 = CHIP8_KEY_C , .raylib = KEY_C      } ,
-    [0x4] = { .chip8 = CHIP8_KEY_4 , .raylib = KEY_FOUR   } ,
-    [0x5] = { .chip8 = CHIP8_KEY_5 , .raylib = KEY_FIVE   } ,
-    [0x6] = { .chip8 = CHIP8_KEY_6 , .raylib = KEY_SIX    } ,
-    [0xD] = { .chip8 = CHIP8_KEY_D , .raylib = KEY_D      } ,
-    [0x7] = { .chip8 = CHIP8_KEY_7 , .raylib = KEY_SEVEN  } ,
-    [0x8] = { .chip8 = CHIP8_KEY_8 , .raylib = KEY_EIGHT  } ,
-    [0x9] = { .chip8 = CHIP8_KEY_9 , .raylib = KEY_NINE   } ,
-    [0xE] = { .chip8 = CHIP8_KEY_E , .raylib = KEY_E      } ,
-    [0xA] = { .chip8 = CHIP8_KEY_A , .raylib = KEY_A      } ,
-    [0x0] = { .chip8 = CHIP8_KEY_0 , .raylib = KEY_ZERO   } ,
-    [0xB] = { .chip8 = CHIP8_KEY_B , .raylib = KEY_B      } ,
-    [0xF] = { .chip8 = CHIP8_KEY_F , .raylib = KEY_F      } ,
-};
+Texture2D load_screen(void) {
+    Image image = {
+        .data = screen_pixels,
+        .width = HIRES_W,
+        .height = HIRES_H,
+        .mipmaps = 1,
+        .format = PIXELFORMAT_UNCOMPRESSED_R8G8B8A8,
+    };
 
-typedef struct {
-    uint64_t frame_buffer[FRAME_H];
-    int8_t sp;
-    uint8_t delay_timer;
-    uint8_t sound_timer;
-    uint8_t memory[MEMORY_SIZE];
-    uint8_t regs[0x10];
-    uint16_t stack[STACK_SIZE];
-    uint16_t pc;
-    uint16_t regi;
-    uint16_t keyboard;
-
-    int cycles;
-    bool should_draw;
-    bool waiting_for_key;
-    bool update_audio_state;
-} Chip8;
-
-bool read_rom_to_memory(Chip8 *chip8, const char *rom) {
-    bool status = true;
-    FILE *file = fopen(rom, "rb");
-    if (file == NULL) {
-        fprintf(stderr, "ERROR: could not open file %s: %s\n", rom, strerror(errno));
-        status = false;
-        goto ERROR;
-    }
+    return LoadTextureFromImage(image);
+}
 
-    long size;
-    if (fseek(file, 0, SEEK_END) < 0 || (size = ftell(file)) < 0) {
-        fprintf(stderr, "ERROR: something went wrong in the reading of %s: %s\n", rom, strerror(errno));
-        status = false;
-        goto ERROR;
+// Expands and uploads only the rows that differ from the screen shown, all of them
+// after a change of resolution
+void blit_frame(const Chip8_Frame *frame, Chip8_Frame *shown, Texture2D screen, const uint32_t colors[4]) {
+    int w = SCREEN_W(frame->hires), h = SCREEN_H(frame->hires);
+    uint64_t rows = 0;
+    for (int y = 0; y < h; y++) {
+        bool changed = frame->hires != shown->hires;
+        for (int p = 0; p < FRAME_PLANES; p++) {
+            changed |= frame->planes[p].lo[y] != shown->planes[p].lo[y];
+            changed |= frame->planes[p].hi[y] != shown->planes[p].hi[y];
+        }
+        rows |= (uint64_t) changed << y;
     }
+    if (rows == 0) return;
 
-    if (size >= MEMORY_SIZE - 0x200) {
-        fprintf(stderr, "ERROR: rom %s is too big. The specified size is %d and the program must start at 0x200\n", rom, MEMORY_SIZE);
-        status = false;
-        goto ERROR;
-    }
+    memcpy(shown->planes, frame->planes, sizeof(shown->planes));
+    shown->hires = frame->hires;
+    chip8_planes_expand_rows(frame->planes, frame->hires, screen_pixels, rows, colors);
 
-    rewind(file);
-    if ((long) fread(chip8->memory + 0x200, sizeof(*chip8->memory)*size, size, file) == 0) {
-        fprintf(stderr, "ERROR: could not read entire file %s: %s\n", rom, strerror(errno));
-        status = false;
-        goto ERROR;
-    }
+    // a single upload from the first to the last changed row
+    int first = __builtin_ctzll(rows);
+    int last = 63 - __builtin_clzll(rows);
+    Rectangle area = { 0, first, w, last - first + 1 };
+    UpdateTextureRec(screen, area, &screen_pixels[first*w]);
+}
 
-ERROR:
-    if (file) {
-        fclose(file);
-    }
+void draw_screen(Texture2D screen, bool hires) {
+    Rectangle source = { 0, 0, SCREEN_W(hires), SCREEN_H(hires) };
+    Rectangle dest = { 0, 0, FRAME_W*WINDOW_FACTOR, FRAME_H*WINDOW_FACTOR };
+    DrawTexturePro(screen, source, dest, (Vector2) { 0, 0 }, 0, WHITE);
+}
 
-    return status;
+// RRGGBB in hex, like the -fg and -bg options
+bool parse_color(const char *s, Color *color) {
+    char *end;
+    if (*s == '#') s++;
+    unsigned long rgb = strtoul(s, &end, 16);
+    if (end - s != 6 || *end != '\0') return false;
+
+    *color = (Color) { (rgb >> 16) & 0xFF, (rgb >> 8) & 0xFF, rgb & 0xFF, 0xFF };
+    return true;
 }
 
-Op op_fetch(Chip8 *chip8) {
-    uint16_t addr = chip8->pc;
-    if (addr > MEMORY_SIZE - 1) {
-        fprintf(stderr, "ERROR: trying to accessing a out of bound adress (%d)\n", addr);
-        exit(1);
+uint16_t poll_keyboard(void) {
+    uint16_t keyboard = 0;
+    for (int i = 0; i < 0x10; i++) {
+        if (IsKeyDown(keyboard_decode_table[i])) {
+            keyboard |= chip8_key_masks[i];
+        }
     }
 
-    chip8->cycles--;
+    return keyboard;
+}
+
+// https://www.raylib.com/examples/audio/loader.html?name=audio_raw_stream
+#define SAMPLE_RATE 44100
+#define FRAME_SAMPLES (SAMPLE_RATE/60)
+// samples of the buffers of the audio device, -audio-buffer
+#define DEFAULT_AUDIO_BUFFER 1024
+#define MIN_AUDIO_BUFFER 256
+#define MAX_AUDIO_BUFFER 4096
+
+// raylib's callback takes no user pointer, so the synth and its queue are globals. The
+// main loop pushes the sound changes with their time, the audio thread plays them
+static Chip8_Audio audio;
+static Chip8_Sound_Queue sound;
 
-    return chip8->memory[addr] << 8 | chip8->memory[addr + 1];
+// Audio input processing callback
+void AudioInputCallback(void *buffer, unsigned int frames)
+{
+    chip8_audio_render_queue(&audio, &sound, buffer, frames);
 }
 
-Op_Type op_decode(Op op) {
-    for (Op_Type type = 0; type < __OP_CNT__; type++) {
-        Op_Pattern op_pattern = op_decode_table[type];
-        if ((op_pattern.mask & op) == op_pattern.value) {
-            return type;
-        }
-    }
+// Queues the change of sound of the emulated frame `frame`, if there is one. A change
+// found after the tick is the sound timer running out, at the end of the frame
+void queue_sound_change(Chip8 *chip8, uint64_t frame, bool ticked) {
+    if (!chip8->update_audio_state) return;
+    chip8->update_audio_state = false;
+
+    uint64_t at = ticked ? (frame + 1)*FRAME_SAMPLES : chip8_sound_time(chip8, frame*FRAME_SAMPLES, FRAME_SAMPLES);
+    // a full queue means the audio is not playing anything anyway
+    chip8_sound_push(&sound, chip8, at);
+}
 
-    assert(0 && "unreacheable");
+char *shift(int *argc, char ***argv) {
+    return (*argc)--, *(*argv)++;
 }
 
-bool is_pixel_active(Chip8 chip8, int x, int y) {
-    return ((chip8.frame_buffer[y] << x) & ((uint64_t) 0x1 << 63)) != 0;
+// in turbo mode instructions run in batches of TURBO_BATCH until TURBO_SLICE ns of
+// each frame are gone, the rest is left for the sleep to land on the next deadline
+#define TURBO_BATCH 4096
+#define TURBO_SLICE (800000000ll/60)
+// frames run back to back to catch up after a stall, the rest are dropped
+#define MAX_CATCH_UP 4
+#define DEFAULT_HEADLESS_FRAMES 600
+
+// a snapshot is pushed every frame, holding BACKSPACE steps back through them
+#define REWIND_SECONDS 60
+#define REWIND_BYTES (4 << 20)
+#define REWIND_KEYFRAME_EVERY 60
+
+// the trace keeps the newest TRACE_RECORDS instructions, 32 bytes each: small enough to
+// stay in cache. Builds with -DDEBUG trace every run to TRACE_DEFAULT
+#define TRACE_RECORDS (1 << 16)
+#define TRACE_DEFAULT "chip8.trace"
+
+void usage(const char *program_name) {
+    printf("    usage: %s [OPTIONS] <ROM.ch8>\n", program_name);
+    printf("    OPTIONS:\n");
+    printf("        -ipf <N>       instructions per frame (default %d, or `ipf` in the rom .conf)\n", CYCLES_PER_SEC);
+    printf("        -quirks <NAME> quirk profile: chip8, vip, chip48, schip or xochip (default chip8,\n");
+    printf("                       or `quirks` in the rom .conf)\n");
+    printf("        -turbo         run as many instructions per frame as the host allows\n");
+    printf("        -headless      no window and no frame cap, prints the final screen and stats\n");
+    printf("        -frames <N>    frames to run in headless mode (default %d)\n", DEFAULT_HEADLESS_FRAMES);
+    printf("        -jit           use the x86-64 recompiler\n");
+    printf("        -fg <RRGGBB>   color of the lit pixels (default FFFFFF)\n");
+    printf("        -bg <RRGGBB>   color of the background (default 000000)\n");
+    printf("        -profile <OUT> write the profile of the run to OUT.json and OUT.folded\n");
+    printf("                       (needs a core built with `make DEFINES=PROFILE`)\n");
+    printf("        -trace <FILE>  write the last %d instructions to FILE at exit, or on F9\n", TRACE_RECORDS);
+    printf("                       (needs a core built with `make DEFINES=DEBUG`, default %s)\n", TRACE_DEFAULT);
+    printf("        -wav <FILE>    headless: write the sound to FILE, %dHz 16-bit mono\n", SAMPLE_RATE);
+    printf("        -audio-buffer <N>  samples of the audio buffers, %d to %d (default %d)\n",
+           MIN_AUDIO_BUFFER, MAX_AUDIO_BUFFER, DEFAULT_AUDIO_BUFFER);
+    printf("        -pin <CPU>     run the emulation thread on that cpu only\n");
+    printf("        -seed <N>      seed of the random numbers (default: the current time)\n");
+    printf("        -record <FILE> write the input of the session to FILE, to -replay it later\n");
+    printf("        -replay <FILE> replay a recorded session headless, at full speed, and check it\n");
+    printf("                       ends up with the same screens\n");
+    printf("    Hold BACKSPACE to rewind (up to %d seconds, not while recording)\n", REWIND_SECONDS);
 }
 
-void blit_frame_buffer(Chip8 chip8) {
-    for (uint8_t y = 0; y < FRAME_H; y++) {
-        for (uint8_t x = 0; x < FRAME_W; x++) {
-            uint8_t mx = FRAME_W - 1 - x;
-            if (is_pixel_active(chip8, x, y)) {
-                DrawRectangle(mx*WINDOW_FACTOR, y*WINDOW_FACTOR, WINDOW_FACTOR, WINDOW_FACTOR, WHITE);
-            } else {
-                DrawRectangle(mx*WINDOW_FACTOR, y*WINDOW_FACTOR, WINDOW_FACTOR, WINDOW_FACTOR, BLACK);
-            }
+void print_frame_buffer(const Chip8 *chip8) {
+    for (int y = 0; y < SCREEN_H(chip8->hires); y++) {
+        for (int x = 0; x < SCREEN_W(chip8->hires); x++) {
+            putchar(is_pixel_active(chip8, x, y) ? '#' : '.');
         }
+        putchar('\n');
     }
 }
 
-void tick_frame(Chip8 *chip8) {
-    static float dt = 0;
-    dt += GetFrameTime();
-    if (dt >= 1/60.0) {
-        dt = 0;
-        chip8->cycles = CYCLES_PER_SEC;
-        chip8->should_draw = true;
-        if (chip8->delay_timer > 0) chip8->delay_timer--;
-        if (chip8->sound_timer > 0) {
-            chip8->sound_timer--;
-            if (chip8->sound_timer == 0) {
-                chip8->update_audio_state = true;
-            }
+void report_error(const Chip8 *chip8, Chip8_Status status) {
+    fprintf(stderr, "ERROR: %s at 0x%04x (op %04x)\n", chip8_status_name(status), chip8->pc, chip8_op_at(chip8, chip8->pc));
+}
+
+int run_headless(Chip8 *chip8, long frames, bool turbo, const char *wav_path) {
+    // the sound of every frame goes to the wav, through the same queue as in the
+    // window so the changes land on the same samples
+    Chip8_Wav wav;
+    int16_t samples[FRAME_SAMPLES];
+    if (wav_path) {
+        if (chip8_wav_open(&wav, wav_path, SAMPLE_RATE) != CHIP8_OK) return 1;
+        chip8_audio_init(&audio, SAMPLE_RATE);
+        chip8_sound_queue_init(&sound);
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    // the instructions skipped in idle loops are not in the rate, they cost next to nothing
+    long long instructions = 0;
+    uint64_t idle_before = chip8->idle_skipped;
+    long changed = 0;
+    long frame;
+    for (frame = 0; frame < frames; frame++) {
+        int budget = turbo ? TURBO_BATCH : chip8->cycles;
+        int before = chip8->cycles;
+        Chip8_Status status = chip8_run_cycles(chip8, budget);
+        instructions += before - chip8->cycles;
+        if (status != CHIP8_OK) {
+            report_error(chip8, status);
+            if (wav_path) chip8_wav_close(&wav);
+            return 1;
+        }
+
+        if (wav_path) queue_sound_change(chip8, frame, false);
+
+        if (chip8_take_dirty_rows(chip8)) changed++;
+        chip8_tick_frame(chip8);
+
+        if (wav_path) {
+            queue_sound_change(chip8, frame, true);
+            chip8_sound_publish(&sound, (frame + 1)*FRAME_SAMPLES);
+            chip8_audio_render_queue(&audio, &sound, samples, FRAME_SAMPLES);
+            chip8_wav_write(&wav, samples, FRAME_SAMPLES);
         }
     }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1e-9;
+
+    long long skipped = chip8->idle_skipped - idle_before;
+    instructions -= skipped;
+    print_frame_buffer(chip8);
+    printf("%ld frames (%ld changed), %lld instructions in %.3fs (%.1f MIPS, %.0f frames/s)\n",
+           frame, changed, instructions, secs, instructions/secs/1e6, frame/secs);
+    printf("%lld instructions skipped in idle loops\n", skipped);
+    if (wav_path && chip8_wav_close(&wav) != CHIP8_OK) return 1;
+    return 0;
 }
 
-void chip8_dump(Chip8 chip8) {
-    for (int i = 0; i < MEMORY_SIZE;) {
-        printf("0x%04x: ", i);
-        for (int k = 0; i < MEMORY_SIZE && k < 8; k++, i += 2) {
-            uint16_t x = chip8.memory[i] << 8 | chip8.memory[i + 1];
-            printf("%04x ", x);
+// Writes prefix.json and prefix.folded
+bool write_profile(const Chip8 *chip8, const char *prefix, const char *rom) {
+    const char *exts[] = { "json", "folded" };
+    for (int i = 0; i < 2; i++) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s.%s", prefix, exts[i]);
+        FILE *file = fopen(path, "w");
+        if (file == NULL) {
+            fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+            return false;
+        }
+
+        if (i == 0) {
+            chip8_profile_write_json(chip8, file);
+        } else {
+            // the rom name without directories, the root of the flame graph
+            const char *name = strrchr(rom, '/');
+            chip8_profile_write_folded(chip8, name ? name + 1 : rom, file);
         }
 
-        printf("\n");
+        fclose(file);
+    }
+
+    return true;
+}
+
+int run_replay(Chip8 *chip8, const char *path) {
+    Chip8_Input_Log log;
+    if (chip8_input_load(&log, path) != CHIP8_OK) return 1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    Chip8_Input_Summary got;
+    Chip8_Status status = chip8_input_replay(&log, chip8, &got);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double secs = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec)*1e-9;
+
+    Chip8_Input_Summary *want = &log.summary;
+    int exit_code = 0;
+    if (status != CHIP8_OK) {
+        report_error(chip8, status);
+        exit_code = 1;
+    } else if (!chip8_input_same(&got, want)) {
+        fprintf(stderr, "ERROR: replay of %s diverged\n", path);
+        fprintf(stderr, "    rom:     %016llx, recorded %016llx\n", (unsigned long long) got.rom_hash, (unsigned long long) want->rom_hash);
+        fprintf(stderr, "    frames:  %u, recorded %u\n", got.frames, want->frames);
+        fprintf(stderr, "    cycles:  %llu, recorded %llu\n", (unsigned long long) got.cycles, (unsigned long long) want->cycles);
+        fprintf(stderr, "    screens: %016llx, recorded %016llx\n", (unsigned long long) got.sequence_hash, (unsigned long long) want->sequence_hash);
+        exit_code = 1;
+    } else {
+        printf("%u frames, %llu instructions replayed in %.3fs (%.0f frames/s), every screen matches\n",
+               got.frames, (unsigned long long) got.cycles, secs, got.frames/secs);
     }
+
+    chip8_input_free(&log);
+    return exit_code;
 }
 
-// https://www.raylib.com/examples/audio/loader.html?name=audio_raw_stream
-#define MAX_SAMPLES               512
-#define MAX_SAMPLES_PER_UPDATE   4096
-#define FREQUENCY 440.0f // (hz)
+// The keyboard changes seen by the window thread, each with the time it was polled
+// at. The emulation thread applies them at the cycle that time falls on
+static Chip8_Key_Queue keys;
+// the screens, from the emulation thread to the window thread
+static Chip8_Display display;
 
-// Audio input processing callback
-void AudioInputCallback(void *buffer, unsigned int frames)
-{
-    static float sineIdx = 0.0f;
-    static float audioFrequency = FREQUENCY;
-    audioFrequency = FREQUENCY + (audioFrequency - FREQUENCY)*0.95f;
-
-    float incr = audioFrequency/44100.0f;
-    short *d = (short *)buffer;
-
-    for (unsigned int i = 0; i < frames; i++)
-    {
-        d[i] = (short)(32000.0f*sinf(2*PI*sineIdx));
-        sineIdx += incr;
-        if (sineIdx > 1.0f) sineIdx -= 1.0f;
+// Input to display latency: from the poll that saw a key change to the present of the
+// first screen after it was applied. A change not followed by one within
+// INPUT_LATENCY_WINDOW ns had nothing to show and is left out
+#define INPUT_LATENCY_WINDOW 250000000ll
+
+// Everything the emulation thread works with. The machine is its own while it runs,
+// the window thread only talks to it through the queues and the atomics
+typedef struct {
+    Chip8 *chip8;
+    bool turbo;
+    const char *trace;
+    Chip8_Rewind *rewind;
+    Chip8_Input_Log *log;
+    bool recording;
+    // core to pin the thread to, -1 to leave it to the os
+    int cpu;
+
+    Chip8_Clock clock;
+    // instructions executed since the start, the clock of the input log
+    uint64_t instructions;
+    // the emulated frame being run, the clock of the sound queue
+    uint64_t sound_frame;
+    // poll time of the oldest key change not on screen yet, 0 when none
+    int64_t input_pending;
+    Chip8_Status status;
+
+    // set by the window thread: the last keyboard polled, and what it asks for
+    _Atomic uint16_t keyboard;
+    _Atomic bool quit;
+    _Atomic bool rewind_held;
+    _Atomic bool trace_requested;
+    // set by the emulation thread
+    _Atomic bool rewinding;
+    _Atomic bool stopped;
+} Emulator;
+
+// Runs up to cycle `at` of a frame of `budget` cycles, `done` of them gone. Waiting for
+// a key the machine idles up to it
+Chip8_Status run_to(Emulator *emu, int budget, int *done, int at) {
+    if (at <= *done) return CHIP8_OK;
+
+    Chip8 *chip8 = emu->chip8;
+    int before = chip8->cycles;
+    Chip8_Status status = chip8_run_cycles(chip8, at - *done);
+    emu->instructions += before - chip8->cycles;
+    if (status != CHIP8_OK) return status;
+
+    *done = at;
+    chip8->cycles = budget - at;
+    return CHIP8_OK;
+}
+
+// Applies the next key change and logs it when recording
+void apply_key(Emulator *emu, const Chip8_Key_Event *event) {
+    if (emu->recording && !chip8_input_keyboard(emu->log, emu->instructions, event->keyboard)) {
+        fprintf(stderr, "ERROR: out of memory for the input log, recording stopped\n");
+        chip8_input_finish(emu->log, emu->instructions, emu->chip8);
+        emu->recording = false;
     }
+
+    chip8_set_keyboard(emu->chip8, event->keyboard);
+    if (emu->input_pending == 0) emu->input_pending = event->at;
+    chip8_keys_pop(&keys);
 }
 
-char *shift(int *argc, char ***argv) {
-    return (*argc)--, *(*argv)++;
+// Runs the frame of the emulated timeline from start to end (monotonic ns), applying
+// the key changes polled before end at the cycle their time falls on: a key that came
+// in halfway through the frame is seen halfway through its instructions
+Chip8_Status run_frame(Emulator *emu, int64_t start, int64_t end, int ticks) {
+    Chip8 *chip8 = emu->chip8;
+    const Chip8_Key_Event *event;
+    if (emu->turbo) {
+        // the keys go at the start, and the frames caught up share the slice of one
+        while ((event = chip8_keys_peek(&keys, end)) != NULL) apply_key(emu, event);
+
+        Chip8_Status status = CHIP8_OK;
+        int64_t slice_end = chip8_clock_now() + TURBO_SLICE/ticks;
+        // waiting for a key, for the display or in an idle loop nothing happens until the
+        // next tick, so the rest of the slice is slept
+        while (status == CHIP8_OK && !chip8->waiting_for_key && !chip8->waiting_for_vblank && !chip8->idle &&
+               chip8_clock_now() < slice_end) {
+            int before = chip8->cycles;
+            status = chip8_run_cycles(chip8, TURBO_BATCH);
+            emu->instructions += before - chip8->cycles;
+        }
+        return status;
+    }
+
+    int budget = chip8->cycles > 0 ? chip8->cycles : 0;
+    int done = 0;
+    while ((event = chip8_keys_peek(&keys, end)) != NULL) {
+        int64_t offset = event->at > start ? event->at - start : 0;
+        Chip8_Status status = run_to(emu, budget, &done, (int) (offset*budget/(end - start)));
+        if (status != CHIP8_OK) return status;
+
+        apply_key(emu, event);
+    }
+
+    return run_to(emu, budget, &done, budget);
+}
+
+// Runs the frames due, each with the keys that came in during it, and ticks the timers
+Chip8_Status run_frames(Emulator *emu, int ticks) {
+    Chip8 *chip8 = emu->chip8;
+    for (int i = 0; i < ticks; i++) {
+        uint64_t index = emu->clock.index - ticks + i;
+        int64_t start = chip8_clock_deadline(&emu->clock, index);
+        int64_t end = chip8_clock_deadline(&emu->clock, index + 1);
+        Chip8_Status status = run_frame(emu, start, end, ticks);
+        if (status != CHIP8_OK) return status;
+        queue_sound_change(chip8, emu->sound_frame, false);
+
+        chip8_tick_frame(chip8);
+        queue_sound_change(chip8, emu->sound_frame, true);
+        emu->sound_frame++;
+        chip8_sound_publish(&sound, emu->sound_frame*FRAME_SAMPLES);
+
+        if (emu->recording && !chip8_input_tick(emu->log, emu->instructions, chip8)) {
+            fprintf(stderr, "ERROR: out of memory for the input log, recording stopped\n");
+            chip8_input_finish(emu->log, emu->instructions, chip8);
+            emu->recording = false;
+        }
+        if (emu->rewind != NULL) chip8_rewind_push(emu->rewind, chip8);
+    }
+
+    return CHIP8_OK;
+}
+
+// Hands the screen to the window thread if it changed, never waiting for it
+void publish_screen(Emulator *emu) {
+    Chip8 *chip8 = emu->chip8;
+    chip8->should_draw = false;
+    if (chip8_take_dirty_rows(chip8) == 0) return;
+
+    int64_t now = chip8_clock_now();
+    int64_t pending = emu->input_pending;
+    if (pending && (atomic_load_explicit(&display.input_shown, memory_order_relaxed) == pending ||
+                    now - pending > INPUT_LATENCY_WINDOW)) {
+        emu->input_pending = pending = 0;
+    }
+
+    Chip8_Frame *frame = chip8_display_back(&display);
+    memcpy(frame->planes, chip8->frame_buffer, sizeof(frame->planes));
+    frame->hires = chip8->hires;
+    frame->frame = emu->sound_frame;
+    frame->input_at = pending;
+    chip8_display_publish(&display, now);
 }
 
-void load_fonts(Chip8 *chip8) {
-    uint16_t start = 0x000;
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11110000; // ****
-
-    chip8->memory[start++] = 0b00100000; //   *
-    chip8->memory[start++] = 0b01100000; //  **
-    chip8->memory[start++] = 0b00100000; //   *
-    chip8->memory[start++] = 0b00100000; //   *
-    chip8->memory[start++] = 0b01110000; //  ***
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b00010000; //    *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b11110000; // ****
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b00010000; //    *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b00010000; //    *
-    chip8->memory[start++] = 0b11110000; // ****
-
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b00010000; //    *
-    chip8->memory[start++] = 0b00010000; //    *
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b00010000; //    *
-    chip8->memory[start++] = 0b11110000; // ****
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11110000; // ****
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b00010000; //    *
-    chip8->memory[start++] = 0b00100000; //   *
-    chip8->memory[start++] = 0b01000000; //  *
-    chip8->memory[start++] = 0b01000000; //  *
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11110000; // ****
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b00010000; //    *
-    chip8->memory[start++] = 0b11110000; // ****
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b10010000; // *  *
-
-    chip8->memory[start++] = 0b11100000; // ***
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11100000; // ***
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11100000; // ***
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b11110000; // ****
-
-    chip8->memory[start++] = 0b11100000; // ***
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b10010000; // *  *
-    chip8->memory[start++] = 0b11100000; // ***
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b11110000; // ****
-
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b11110000; // ****
-    chip8->memory[start++] = 0b10000000; // *
-    chip8->memory[start++] = 0b10000000; // *
+void *emulation_main(void *arg) {
+    Emulator *emu = arg;
+    Chip8 *chip8 = emu->chip8;
+
+    if (emu->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(emu->cpu, &set);
+        int error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (error != 0) {
+            fprintf(stderr, "WARNING: could not pin the emulation to cpu %d: %s\n", emu->cpu, strerror(error));
+        }
+    }
+
+    // the 60Hz of the timers and of the frames, apart from the display rate
+    chip8_clock_init(&emu->clock, 60, MAX_CATCH_UP);
+    while (!atomic_load(&emu->quit)) {
+        // frames due since the last time around: one, or a few to catch up after a stall
+        int ticks = chip8_clock_due(&emu->clock);
+
+        if (emu->trace && atomic_exchange(&emu->trace_requested, false) &&
+            chip8_trace_write(chip8, emu->trace) == CHIP8_OK) {
+            printf("INFO: trace written to %s\n", emu->trace);
+        }
+
+        if (emu->rewind != NULL && atomic_load(&emu->rewind_held)) {
+            // one frame back per frame, the newest snapshot is where we are now
+            for (int i = 0; i < ticks; i++) {
+                chip8_rewind_restore(emu->rewind, chip8_rewind_count(emu->rewind) > 1 ? 1 : 0, chip8);
+            }
+            atomic_store(&emu->rewinding, true);
+        } else {
+            if (atomic_load(&emu->rewinding)) {
+                // carry on with the sound of the frame we went back to, and with the keys
+                // as they are, not as they were
+                chip8_set_keyboard(chip8, atomic_load(&emu->keyboard));
+                chip8_sound_push(&sound, chip8, emu->sound_frame*FRAME_SAMPLES);
+                atomic_store(&emu->rewinding, false);
+            }
+
+            emu->status = run_frames(emu, ticks);
+            if (emu->status != CHIP8_OK) {
+                report_error(chip8, emu->status);
+                break;
+            }
+        }
+
+        publish_screen(emu);
+        chip8_clock_sleep(&emu->clock);
+    }
+
+    atomic_store(&emu->stopped, true);
+    return NULL;
 }
 
 int main(int argc, char **argv) {
     char *program_name = shift(&argc, &argv);
-    if (argc <= 0) {
+    char *rom = NULL;
+    bool use_jit = false;
+    bool turbo = false;
+    bool headless = false;
+    long frames = DEFAULT_HEADLESS_FRAMES;
+    uint64_t seed = time(NULL);
+    char *record = NULL;
+    char *replay = NULL;
+    char *profile = NULL;
+    char *trace = NULL;
+    char *wav = NULL;
+    int ipf = 0;
+    int audio_buffer = DEFAULT_AUDIO_BUFFER;
+    int cpu = -1;
+    Chip8_Quirks quirks = __CHIP8_QUIRKS_CNT__;
+    Color fg = WHITE;
+    Color bg = BLACK;
+    while (argc > 0) {
+        char *arg = shift(&argc, &argv);
+        if (strcmp(arg, "-jit") == 0) {
+            use_jit = true;
+        } else if (strcmp(arg, "-turbo") == 0) {
+            turbo = true;
+        } else if (strcmp(arg, "-headless") == 0) {
+            headless = true;
+        } else if (strcmp(arg, "-seed") == 0 || strcmp(arg, "-record") == 0 || strcmp(arg, "-replay") == 0 ||
+                   strcmp(arg, "-profile") == 0 || strcmp(arg, "-trace") == 0 || strcmp(arg, "-wav") == 0) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: missing value for %s\n", arg);
+                usage(program_name);
+                return 1;
+            }
+
+            char *value = shift(&argc, &argv);
+            if (strcmp(arg, "-seed") == 0) {
+                seed = strtoull(value, NULL, 0);
+            } else if (strcmp(arg, "-record") == 0) {
+                record = value;
+            } else if (strcmp(arg, "-replay") == 0) {
+                replay = value;
+            } else if (strcmp(arg, "-profile") == 0) {
+                profile = value;
+            } else if (strcmp(arg, "-trace") == 0) {
+                trace = value;
+            } else {
+                wav = value;
+            }
+        } else if (strcmp(arg, "-fg") == 0 || strcmp(arg, "-bg") == 0) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: missing value for %s\n", arg);
+                usage(program_name);
+                return 1;
+            }
+
+            char *value = shift(&argc, &argv);
+            if (!parse_color(value, strcmp(arg, "-fg") == 0 ? &fg : &bg)) {
+                fprintf(stderr, "ERROR: %s expects a color as RRGGBB, got %s\n", arg, value);
+                return 1;
+            }
+        } else if (strcmp(arg, "-quirks") == 0) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: missing value for %s\n", arg);
+                usage(program_name);
+                return 1;
+            }
+
+            char *value = shift(&argc, &argv);
+            quirks = chip8_quirks_find(value);
+            if (quirks == __CHIP8_QUIRKS_CNT__) {
+                fprintf(stderr, "ERROR: unknown quirk profile %s\n", value);
+                usage(program_name);
+                return 1;
+            }
+        } else if (strcmp(arg, "-pin") == 0) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: missing value for %s\n", arg);
+                usage(program_name);
+                return 1;
+            }
+
+            char *value = shift(&argc, &argv);
+            char *end;
+            cpu = strtol(value, &end, 10);
+            if (*value == '\0' || *end != '\0' || cpu < 0 || cpu >= CPU_SETSIZE) {
+                fprintf(stderr, "ERROR: %s expects a cpu number, got %s\n", arg, value);
+                return 1;
+            }
+        } else if (strcmp(arg, "-ipf") == 0 || strcmp(arg, "-frames") == 0 || strcmp(arg, "-audio-buffer") == 0) {
+            if (argc <= 0) {
+                fprintf(stderr, "ERROR: missing value for %s\n", arg);
+                usage(program_name);
+                return 1;
+            }
+
+            char *str = shift(&argc, &argv);
+            char *end;
+            long value = strtol(str, &end, 10);
+            if (*str == '\0' || *end != '\0' || value <= 0 || value > INT_MAX) {
+                fprintf(stderr, "ERROR: %s must be a positive number, got %s\n", arg, str);
+                return 1;
+            }
+
+            if (strcmp(arg, "-ipf") == 0) {
+                ipf = value;
+            } else if (strcmp(arg, "-audio-buffer") == 0) {
+                if (value < MIN_AUDIO_BUFFER || value > MAX_AUDIO_BUFFER) {
+                    fprintf(stderr, "ERROR: %s must be between %d and %d\n", arg, MIN_AUDIO_BUFFER, MAX_AUDIO_BUFFER);
+                    return 1;
+                }
+                audio_buffer = value;
+            } else {
+                frames = value;
+            }
+        } else {
+            rom = arg;
+        }
+    }
+
+    if (rom == NULL) {
         fprintf(stderr, "ERROR: missing ROM file\n");
-        printf("    usage: %s <ROM.ch8>\n", program_name);
+        usage(program_name);
         return 1;
     }
 
-    Chip8 chip8 = {0};
-    char *rom = shift(&argc, &argv);
-    if (!read_rom_to_memory(&chip8, rom)) {
+    Chip8 chip8;
+    chip8_init(&chip8);
+    if (chip8_load_rom(&chip8, rom) != CHIP8_OK || chip8_load_config(&chip8, rom) != CHIP8_OK) {
         return 1;
     }
 
-    srand(time(NULL));
+    if (ipf > 0) {
+        chip8.ipf = ipf;
+        chip8.cycles = ipf;
+    }
+    if (quirks != __CHIP8_QUIRKS_CNT__) chip8_set_quirks(&chip8, quirks);
+
+    if (use_jit && !chip8_jit_enable(&chip8)) {
+        fprintf(stderr, "WARNING: the JIT is not supported on this host, using the interpreter\n");
+    }
+
+    chip8_seed(&chip8, seed);
+
+    if (profile && !chip8_profile_enable(&chip8)) {
+        fprintf(stderr, "ERROR: the core was built without the profiler, rebuild it with `make DEFINES=PROFILE`\n");
+        return 1;
+    }
 
-    chip8.pc = 0x200;
-    chip8.cycles = CYCLES_PER_SEC;
-    load_fonts(&chip8);
+#if defined(DEBUG)
+    if (trace == NULL) trace = TRACE_DEFAULT;
+#endif
+    if (trace && !chip8_trace_enable(&chip8, TRACE_RECORDS)) {
+        fprintf(stderr, "ERROR: could not enable the trace, it needs a core built with `make DEFINES=DEBUG`\n");
+        return 1;
+    }
 
 #if defined(DUMP_AND_DIE)
-    chip8_dump(chip8);
+    chip8_dump(&chip8);
     return 0;
 #endif
 
 #if defined(DEBUG)
-    chip8_dump(chip8);
+    chip8_dump(&chip8);
 #endif
 
+    if (wav && (!headless || replay)) {
+        fprintf(stderr, "ERROR: -wav only works with -headless\n");
+        return 1;
+    }
+
+    if (replay) {
+        int exit_code = run_replay(&chip8, replay);
+        if (profile && !write_profile(&chip8, profile, rom)) exit_code = 1;
+        if (trace && chip8_trace_write(&chip8, trace) != CHIP8_OK) exit_code = 1;
+        chip8_profile_disable(&chip8);
+        chip8_trace_disable(&chip8);
+        chip8_jit_disable(&chip8);
+        return exit_code;
+    }
+
+    if (headless && record) {
+        fprintf(stderr, "ERROR: -record needs the window, there is no input to record in headless mode\n");
+        return 1;
+    }
+
+    if (headless) {
+        int exit_code = run_headless(&chip8, frames, turbo, wav);
+        if (profile && !write_profile(&chip8, profile, rom)) exit_code = 1;
+        if (trace && chip8_trace_write(&chip8, trace) != CHIP8_OK) exit_code = 1;
+        chip8_profile_disable(&chip8);
+        chip8_trace_disable(&chip8);
+        chip8_jit_disable(&chip8);
+        return exit_code;
+    }
+
 #if !defined(DEBUG)
     SetTraceLogLevel(LOG_ERROR);
 #endif
 
     InitWindow(FRAME_W*WINDOW_FACTOR, FRAME_H*WINDOW_FACTOR, "Chip8");
+    // only the window is paced by raylib, the emulation runs on its own clock
+    SetTargetFPS(60);
 
     InitAudioDevice();
-    SetAudioStreamBufferSizeDefault(MAX_SAMPLES_PER_UPDATE);
-
-    // Init raw audio stream (sample rate: 44100, sample size: 16bit-short, channels: 1-mono)
-    AudioStream stream = LoadAudioStream(44100, 16, 1);
+    SetAudioStreamBufferSizeDefault(audio_buffer);
+
+    // The stream always plays, the silence too: the sound starts and stops where the
+    // queue says. A change is heard a buffer and a frame after it was emulated
+    chip8_audio_init(&audio, SAMPLE_RATE);
+    audio.latency = audio_buffer + FRAME_SAMPLES;
+    chip8_sound_queue_init(&sound);
+    AudioStream stream = LoadAudioStream(SAMPLE_RATE, 16, 1);
     SetAudioStreamCallback(stream, AudioInputCallback);
+    PlayAudioStream(stream);
+    bool paused = false;
+
+    // the screen shown, what the screens published are compared with. The second XO-CHIP
+    // plane is gray, and light gray where it overlaps the first
+    const uint32_t colors[4] = { color_pixel(bg), color_pixel(fg), color_pixel(GRAY), color_pixel(LIGHTGRAY) };
+    static Chip8_Frame shown;
+    memcpy(shown.planes, chip8.frame_buffer, sizeof(shown.planes));
+    shown.hires = chip8.hires;
+    chip8_planes_expand_rows(shown.planes, shown.hires, screen_pixels, ~(uint64_t) 0, colors);
+    Texture2D screen = load_screen();
+
+    // going back in time would leave the log behind, so there is no rewind while recording
+    Chip8_Rewind *rewind = NULL;
+    if (record == NULL) {
+        rewind = chip8_rewind_create(REWIND_BYTES, REWIND_SECONDS*60, REWIND_KEYFRAME_EVERY);
+        if (rewind == NULL) {
+            fprintf(stderr, "WARNING: could not allocate the rewind buffer, rewind is disabled\n");
+        }
+    }
 
-    Op op;
-    Op_Type type;
-    while (!WindowShouldClose()) {
-        if (chip8.update_audio_state) {
-            if (chip8.sound_timer > 0) {
-                PlayAudioStream(stream);
-            } else {
-                StopAudioStream(stream);
-            }
+    Chip8_Input_Log log;
+    if (record) chip8_input_start(&log, &chip8);
+
+    chip8_keys_init(&keys);
+    chip8_display_init(&display);
+    uint16_t polled = chip8.keyboard;
+    Emulator emu = {
+        .chip8 = &chip8,
+        .turbo = turbo,
+        .trace = trace,
+        .rewind = rewind,
+        .log = &log,
+        .recording = record != NULL,
+        .cpu = cpu,
+        .status = CHIP8_OK,
+        .keyboard = polled,
+    };
+
+    pthread_t emulation;
+    if (pthread_create(&emulation, NULL, emulation_main, &emu) != 0) {
+        fprintf(stderr, "ERROR: could not start the emulation thread\n");
+        return 1;
+    }
+
+    // input to display latency, see INPUT_LATENCY_WINDOW
+    int64_t input_shown = 0;
+    uint64_t input_count = 0;
+    double input_sum = 0;
+    int64_t input_max = 0;
+
+    // From here on the machine belongs to the emulation thread: this one polls the keys,
+    // presents the screens it publishes and follows the rewind for the sound
+    while (!WindowShouldClose() && !atomic_load(&emu.stopped)) {
+        bool held = rewind != NULL && IsKeyDown(KEY_BACKSPACE);
+        atomic_store(&emu.rewind_held, held);
+        if (trace && IsKeyPressed(KEY_F9)) atomic_store(&emu.trace_requested, true);
+
+        bool rewinding = atomic_load(&emu.rewinding);
+        if (rewinding != paused) {
+            if (rewinding) PauseAudioStream(stream); else ResumeAudioStream(stream);
+            paused = rewinding;
         }
 
-        for (int i = 0; i < 16; i++) {
-            bool is_key_down = chip8.keyboard & keyboard_decode_table[i].chip8;
-            if (is_key_down && IsKeyUp(keyboard_decode_table[i].raylib)) {
-                chip8.keyboard &= ~keyboard_decode_table[i].chip8;
-                if (chip8.waiting_for_key) {
-                    chip8.waiting_for_key = false;
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    chip8.regs[x] = i;
-                }
-            } else if (IsKeyDown(keyboard_decode_table[i].raylib)) {
-                chip8.keyboard |= keyboard_decode_table[i].chip8;
+        // raylib updates the keys once per frame (in EndDrawing), so once is enough
+        if (!held) {
+            uint16_t keyboard = poll_keyboard();
+            if (keyboard != polled) {
+                polled = keyboard;
+                atomic_store(&emu.keyboard, keyboard);
+                chip8_keys_push(&keys, chip8_clock_now(), keyboard);
             }
         }
 
-        if (chip8.cycles > 0 && !chip8.waiting_for_key) {
-            op = op_fetch(&chip8);
-            type = op_decode(op);
+        const Chip8_Frame *frame = chip8_display_take(&display);
+        if (frame) blit_frame(frame, &shown, screen, colors);
 
-#if defined(DEBUG)
-            printf("0x%04x: 0x%04x | DECODED: %s [%d]\n", chip8.pc, op, op_names[type], type);
-#endif
+        BeginDrawing();
+        draw_screen(screen, shown.hires);
+        EndDrawing();
 
-            switch (type) {
-                // 00E0 - CLS
-                case OP_CLS: {
-                    memset(chip8.frame_buffer, 0, sizeof(*chip8.frame_buffer)*FRAME_H);
-                    chip8.pc += 2;
-                } break;
-
-                // 00EE - RET
-                case OP_RET: {
-                    if (chip8.sp <= 0) {
-                        fprintf(stderr, "ERROR: stack underflow\n");
-                        return 1;
-                    }
-
-                    chip8.pc = chip8.stack[--chip8.sp];
-                } break;
-
-                // 2nnn - CALL addr
-                case OP_CALL: {
-                    if (chip8.sp >= STACK_SIZE) {
-                        fprintf(stderr, "ERROR: stack overflow\n");
-                        return 1;
-                    }
-
-                    chip8.stack[chip8.sp++] = chip8.pc + 2;
-                    chip8.pc = op & 0x0FFF;
-                } break;
-
-                // 0nnn - SYS addr
-                case OP_SYS: {
-                    TODO("OP_SYS");
-                } break;
-
-                // 3xkk - SE Vx, byte
-                case OP_SE_RB: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t k = op & 0x00FF;
-                    if (chip8.regs[x] == k) {
-                        chip8.pc += 2;
-                    }
-
-                    chip8.pc += 2;
-                } break;
-
-                // 5xy0 - SE Vx, Vy
-                case OP_SE_RR: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    if (chip8.regs[x] == chip8.regs[y]) {
-                        chip8.pc += 2;
-                    }
-
-                    chip8.pc += 2;
-                } break;
-
-                // 8xy1 - OR Vx, Vy
-                case OP_OR: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    chip8.regs[x] |= chip8.regs[y];
-                    chip8.regs[0xF] = 0;
-                    chip8.pc += 2;
-                } break;
-
-                // 8xy2 - AND Vx, Vy
-                case OP_AND: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    chip8.regs[x] &= chip8.regs[y];
-                    chip8.regs[0xF] = 0;
-                    chip8.pc += 2;
-                } break;
-
-                // 8xy3 - XOR Vx, Vy
-                case OP_XOR: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    chip8.regs[x] ^= chip8.regs[y];
-                    chip8.regs[0xF] = 0;
-                    chip8.pc += 2;
-                } break;
-
-                // 8xy5 - SUB Vx, Vy
-                case OP_SUB: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    uint8_t vx = chip8.regs[x];
-                    uint8_t vy = chip8.regs[y];
-
-                    chip8.regs[x] = vx - vy;
-                    chip8.regs[0xF] = vx >= vy;
-                    chip8.pc += 2;
-                } break;
-
-                // 8xy6 - SHR Vx {, Vy}
-                case OP_SHR: {
-                    // I found very strange that we accept VY but dont use it
-                    // Its actually a quirk -> https://chip8.gulrak.net/#quirk6
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    uint8_t vy = chip8.regs[y];
-                    chip8.regs[x] = vy >> 1;
-                    chip8.regs[0xF] = vy & 1;
-                    chip8.pc += 2;
-                } break;
-
-                // 8xyE - SHL Vx {, Vy}
-                case OP_SHL: {
-                    // I found very strange that we accept VY but dont use it
-                    // Its actually a quirk -> https://chip8.gulrak.net/#quirk6
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    uint8_t vy = chip8.regs[y];
-                    chip8.regs[x] = vy << 1;
-                    chip8.regs[0xF] = (vy >> 7) & 1;
-                    chip8.pc += 2;
-                } break;
-
-                // 8xy7 - SUBN Vx, Vy
-                case OP_SUBN: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    uint8_t vx = chip8.regs[x];
-                    uint8_t vy = chip8.regs[y];
-
-                    chip8.regs[x] = vy - vx;
-                    chip8.regs[0xF] = vy >= vx;
-                    chip8.pc += 2;
-                } break;
-
-                // 4xkk - SNE Vx, byte
-                case OP_SNE_R_B: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t k = op & 0x0FF;
-                    if (chip8.regs[x] != k) {
-                        chip8.pc += 2;
-                    }
-
-                    chip8.pc += 2;
-                } break;
-
-                // 9xy0 - SNE Vx, Vy
-                case OP_SNE_R_R: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    if (chip8.regs[x] != chip8.regs[y]) {
-                        chip8.pc += 2;
-                    }
-
-                    chip8.pc += 2;
-                } break;
-
-                // 1nnn - JP addr
-                case OP_JP_ADDR: {
-                    chip8.pc = op & 0x0FFF;
-                } break;
-
-                // Bnnn - JP V0, addr
-                case OP_JP_V0_ADDR: {
-                    uint16_t addr = op & 0x0FFF;
-                    chip8.pc = addr + chip8.regs[0];
-                } break;
-
-                // Cxkk - RND Vx, byte
-                case OP_RND: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t k = op & 0x0FF;
-                    chip8.regs[x] = ((uint8_t) rand()) & k;
-                    chip8.pc += 2;
-                } break;
-
-                // Dxyn - DRW Vx, Vy, nibble
-                case OP_DRW: {
-                    chip8.regs[0xF] = 0;
-                    int8_t x = chip8.regs[(op & 0x0F00) >> 8] % FRAME_W;
-                    uint8_t y = chip8.regs[(op & 0x00F0) >> 4] % FRAME_H;
-                    uint8_t n = op & 0x000F;
-                    for (int8_t i = 0; y < FRAME_H && i < n; i++, y++) {
-                        uint16_t mem = chip8.regi + i;
-                        if (mem >= MEMORY_SIZE) {
-                            fprintf(stderr, "ERROR: out of bounds access\n");
-                            return 1;
-                        }
-
-                        uint8_t sprite_byte = chip8.memory[mem];
-                        for (uint8_t k = 0, index = x + k; index < FRAME_W && k < 8; k++, index = x + k) {
-                            uint8_t current_bit = (chip8.frame_buffer[y] >> index) & 1; // Get current state of pixel
-                            uint8_t sprite_bit = (sprite_byte >> (7 - k)) & 1;          // Get state from sprite
-                            uint64_t frame_bit = sprite_bit^current_bit;                // Get new pixel state
-                            chip8.frame_buffer[y] &= ~((uint64_t)1 << index);           // Clear the current pixel
-                            chip8.frame_buffer[y] |= frame_bit << index;                // Set bit on the frame buffer
-
-                            chip8.regs[0xF] |= current_bit & sprite_bit;
-                        }
-                    }
-
-                    chip8.pc += 2;
-                } break;
-
-                // Ex9E - SKP Vx
-                case OP_SKP: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t key = chip8.regs[x];
-                    if (key > 0xF) {
-                        fprintf(stderr, "ERROR: invalid key %d\n", key);
-                        return 1;
-                    }
-
-                    if (chip8.keyboard & keyboard_decode_table[key].chip8) {
-                        chip8.pc += 2;
-                    }
-
-                    chip8.pc += 2;
-                } break;
-
-                // ExA1 - SKNP Vx
-                case OP_SKNP: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t key = chip8.regs[x];
-                    if (key > 0xF) {
-                        fprintf(stderr, "ERROR: invalid key %d\n", key);
-                        return 1;
-                    }
-
-                    if (!(chip8.keyboard & keyboard_decode_table[key].chip8)) {
-                        chip8.pc += 2;
-                    }
-
-                    chip8.pc += 2;
-                } break;
-
-                // 7xkk - ADD Vx, byte
-                case OP_ADD_R_B: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t value = op & 0x00FF;
-                    chip8.regs[x] = (chip8.regs[x] + value) & 0xFF;
-                    chip8.pc += 2;
-                } break;
-
-                // 8xy4 - ADD Vx, Vy
-                case OP_ADD_R_R: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    uint16_t t = chip8.regs[x] + chip8.regs[y];
-                    chip8.regs[x] = t;
-                    chip8.regs[0xF] = t > 255;
-                    chip8.pc += 2;
-                } break;
-
-                // Fx1E - ADD I, Vx
-                case OP_ADD_I_R: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    chip8.regi += chip8.regs[x];
-                    chip8.pc += 2;
-                } break;
-
-                // 6xkk - LD Vx, byte
-                case OP_LD_R_B: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    chip8.regs[x] = op & 0x00FF;
-                    chip8.pc += 2;
-                } break;
-
-                // 8xy0 - LD Vx, Vy
-                case OP_LD_R_R: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint8_t y = (op & 0x00F0) >> 4;
-                    chip8.regs[x] = chip8.regs[y];
-                    chip8.pc += 2;
-                } break;
-
-                // Annn - LD I, addr
-                case OP_LD_I_ADDR: {
-                    chip8.regi = op & 0x0FFF;
-                    chip8.pc += 2;
-                } break;
-
-                // Fx07 - LD Vx, DT
-                case OP_LD_R_DT: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    chip8.regs[x] = chip8.delay_timer;
-                    chip8.pc += 2;
-                } break;
-
-                // Fx0A - LD Vx, K
-                case OP_LD_R_K: {
-                    chip8.waiting_for_key = true;
-                    chip8.pc += 2;
-                } break;
-
-                // Fx15 - LD DT, Vx
-                case OP_LD_DT_R: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    chip8.delay_timer = chip8.regs[x];
-                    chip8.pc += 2;
-                } break;
-
-                // Fx18 - LD ST, Vx
-                case OP_LD_ST_R: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    chip8.sound_timer = chip8.regs[x];
-                    chip8.update_audio_state = true;
-                    chip8.pc += 2;
-                } break;
-
-                // Fx29 - LD F, Vx
-                case OP_LD_FONT_R: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    chip8.regi = chip8.regs[x]*5;
-                    chip8.pc += 2;
-                } break;
-
-                // Fx33 - LD B, Vx
-                case OP_LD_BCD_R: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    uint16_t start = chip8.regi;
-                    if (start >= (MEMORY_SIZE - 3)) {
-                        printf("ERROR: OP_LD_BCD_R out of bounds\n");
-                        return 1;
-                    }
-
-                    uint8_t v = chip8.regs[x];
-                    chip8.memory[start + 0] = v / 100;
-                    chip8.memory[start + 1] = (v / 10) % 10;
-                    chip8.memory[start + 2] = (v % 10) % 10;
-                    chip8.pc += 2;
-                } break;
-
-                // Fx55 - LD [I], Vx
-                case OP_LD_IMEM_R: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    for (uint8_t i = 0; i <= x; i++) {
-                        uint16_t mem = chip8.regi++;
-                        if (mem >= MEMORY_SIZE) {
-                            printf("ERROR: OP_LD_R_IMEM out of bounds\n");
-                            return 1;
-                        }
-
-                        chip8.memory[mem] = chip8.regs[i];
-                    }
-
-                    chip8.pc += 2;
-                } break;
-
-                // Fx65 - LD Vx, [I]
-                case OP_LD_R_IMEM: {
-                    uint8_t x = (op & 0x0F00) >> 8;
-                    for (uint8_t i = 0; i <= x; i++) {
-                        uint16_t mem = chip8.regi++;
-                        if (mem >= MEMORY_SIZE) {
-                            printf("ERROR: OP_LD_R_IMEM out of bounds\n");
-                            return 1;
-                        }
-
-                        chip8.regs[i] = chip8.memory[mem];
-                    }
-
-                    chip8.pc += 2;
-                } break;
-
-                default: {
-                    fprintf(stderr, "ERROR: op %04x not implemented", op);
-                    return 1;
+        if (frame) {
+            int64_t now = chip8_clock_now();
+            chip8_display_presented(&display, frame, now);
+            if (frame->input_at && frame->input_at != input_shown) {
+                input_shown = frame->input_at;
+                int64_t latency = now - input_shown;
+                if (latency <= INPUT_LATENCY_WINDOW) {
+                    input_count++;
+                    input_sum += latency;
+                    if (latency > input_max) input_max = latency;
                 }
             }
         }
+    }
 
-        BeginDrawing();
-
-        if (chip8.should_draw) {
-            blit_frame_buffer(chip8);
-            chip8.should_draw = false;
-        }
-
-        EndDrawing();
+    atomic_store(&emu.quit, true);
+    pthread_join(emulation, NULL);
+    int exit_code = emu.status != CHIP8_OK;
 
-        tick_frame(&chip8);
+    if (record) {
+        // a session that ends on a fault is kept too, the replay stops on the same fault
+        if (emu.recording) chip8_input_finish(&log, emu.instructions, &chip8);
+        if (chip8_input_save(&log, record) != CHIP8_OK) exit_code = 1;
+        chip8_input_free(&log);
     }
 
+    Chip8_Clock_Stats stats = chip8_clock_stats(&emu.clock);
+    printf("INFO: timers: %.3fHz over %.1fs, ticks late by %.2fms on average (%.2fms worst), "
+           "%llu dropped, %llu catch ups\n", stats.tick_hz, stats.seconds, stats.tick_late_mean_ms,
+           stats.tick_late_max_ms, (unsigned long long) stats.dropped, (unsigned long long) stats.catch_ups);
+    printf("INFO: frames: %.2fms on average, %.3fms jitter, %.2fms worst, sleeps woke %.0fus late (%.0fus worst)\n",
+           stats.frame_mean_ms, stats.frame_jitter_ms, stats.frame_max_ms, stats.wake_mean_us, stats.wake_max_us);
+    printf("INFO: input: %llu key changes shown %.2fms after they were polled on average (%.2fms worst)\n",
+           (unsigned long long) input_count, input_count ? input_sum/input_count*1e-6 : 0.0, input_max*1e-6);
+    printf("INFO: display: %llu screens presented %.2fms after they were published on average (%.2fms worst), "
+           "%llu dropped\n", (unsigned long long) display.presented,
+           display.presented ? display.latency_sum/display.presented*1e-6 : 0.0, display.latency_max*1e-6,
+           (unsigned long long) chip8_display_dropped(&display));
+    printf("INFO: audio: %llu underruns, %llu resyncs\n",
+           (unsigned long long) atomic_load(&sound.underruns), (unsigned long long) atomic_load(&sound.resyncs));
+    if (profile && !write_profile(&chip8, profile, rom)) exit_code = 1;
+    // also after a fault: the trace ends with the instruction that faulted
+    if (trace && chip8_trace_write(&chip8, trace) != CHIP8_OK) exit_code = 1;
+
+    chip8_rewind_destroy(rewind);
+    chip8_profile_disable(&chip8);
+    chip8_trace_disable(&chip8);
+    chip8_jit_disable(&chip8);
+    UnloadTexture(screen);
     UnloadAudioStream(stream);
     CloseAudioDevice();
     CloseWindow();
 
-    return 0;
+    return exit_code;
 }
 
 // Copyright (c) 2025 Jonathan Santos
@@ -0,0 +1,155 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+
+#include "chip8.h"
+
+// Decoder of the execution traces written by chip8_trace_write (see chip8_trace.c for
+// the format). Prints an instruction per line, with what it changed:
+//
+//     ./bin/trace_dump [-last N] FILE
+//
+//            cycle      pc  op    instruction   changes
+//          1048575  0x0236  7a01  ADD_R_B       VA=08
+//
+// The last line is the state the machine was left in, at the instruction it would run
+// next. After a fault that is the faulting one, also the line before it.
+
+#define MAGIC "C8TR"
+#define VERSION 1
+#define HEADER_SIZE (4 + 1 + 8 + 8)
+#define RECORD_SIZE 32
+
+static uint64_t get(const uint8_t *p, int bytes) {
+    uint64_t v = 0;
+    for (int i = 0; i < bytes; i++) v |= (uint64_t) p[i] << (8*i);
+    return v;
+}
+
+static void parse_record(const uint8_t *p, Chip8_Trace_Record *r) {
+    r->cycle = get(p, 8);
+    r->pc = get(p + 8, 2);
+    r->op = get(p + 10, 2);
+    r->regi = get(p + 12, 2);
+    r->sp = p[14];
+    memcpy(r->regs, p + 16, sizeof(r->regs));
+}
+
+static void print_record(const Chip8_Trace_Record *r, const Chip8_Trace_Record *next) {
+    Op_Type type = op_decode(r->op);
+    printf("%16llu  0x%04x  %04x  %-12s ", (unsigned long long) r->cycle, r->pc, r->op,
+           type < __OP_CNT__ ? op_names[type] : "INVALID");
+    if (next == NULL) {
+        printf(" (stopped here)\n");
+        return;
+    }
+
+    for (int i = 0; i < 0x10; i++) {
+        if (next->regs[i] != r->regs[i]) printf(" V%X=%02x", i, next->regs[i]);
+    }
+    if (next->regi != r->regi) printf(" I=0x%03x", next->regi);
+    if (next->sp != r->sp) printf(" SP=%d", next->sp);
+    putchar('\n');
+}
+
+char *shift(int *argc, char ***argv) {
+    return (*argc)--, *(*argv)++;
+}
+
+void usage(const char *program_name) {
+    fprintf(stderr, "    usage: %s [OPTIONS] <FILE>\n", program_name);
+    fprintf(stderr, "    OPTIONS:\n");
+    fprintf(stderr, "        -last <N>      only the last N instructions\n");
+}
+
+int main(int argc, char **argv) {
+    char *program_name = shift(&argc, &argv);
+    const char *path = NULL;
+    uint64_t last = UINT64_MAX;
+    while (argc > 0) {
+        char *arg = shift(&argc, &argv);
+        if (strcmp(arg, "-last") == 0) {
+            if (argc == 0) {
+                fprintf(stderr, "ERROR: %s expects a value\n", arg);
+                usage(program_name);
+                return 1;
+            }
+            last = strtoull(shift(&argc, &argv), NULL, 10);
+        } else if (arg[0] == '-') {
+            fprintf(stderr, "ERROR: unknown option %s\n", arg);
+            usage(program_name);
+            return 1;
+        } else {
+            path = arg;
+        }
+    }
+
+    if (path == NULL) {
+        fprintf(stderr, "ERROR: missing trace file\n");
+        usage(program_name);
+        return 1;
+    }
+
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "ERROR: could not open file %s: %s\n", path, strerror(errno));
+        return 1;
+    }
+
+    int exit_code = 0;
+    uint8_t header[HEADER_SIZE];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+        memcmp(header, MAGIC, 4) != 0 || header[4] != VERSION) {
+        fprintf(stderr, "ERROR: %s is not a trace\n", path);
+        exit_code = 1;
+        goto ERROR;
+    }
+
+    uint64_t count = get(header + 5, 8);
+    uint64_t total = get(header + 13, 8);
+    uint64_t skip = count > last ? count - last : 0;
+    if (total > count) printf("(%llu older instructions were not kept)\n", (unsigned long long) (total - count));
+    if (fseek(file, skip*RECORD_SIZE, SEEK_CUR) != 0) {
+        fprintf(stderr, "ERROR: could not read trace %s: %s\n", path, strerror(errno));
+        exit_code = 1;
+        goto ERROR;
+    }
+
+    op_decode_init();
+    printf("%16s  %6s  %-4s  %-12s  %s\n", "cycle", "pc", "op", "instruction", "changes");
+
+    // a record is printed once the next one, what it changed, is read
+    Chip8_Trace_Record prev, cur;
+    uint8_t bytes[RECORD_SIZE];
+    for (uint64_t i = skip; i <= count; i++) {
+        if (fread(bytes, 1, sizeof(bytes), file) != sizeof(bytes)) {
+            fprintf(stderr, "ERROR: %s is truncated\n", path);
+            exit_code = 1;
+            goto ERROR;
+        }
+
+        parse_record(bytes, &cur);
+        if (i > skip) print_record(&prev, &cur);
+        prev = cur;
+    }
+    print_record(&prev, NULL);
+
+ERROR:
+    fclose(file);
+    return exit_code;
+}
+// Copyright (c) 2025 Jonathan Santos
+// Permission is hereby granted, free of charge, to any person obtaining a copy of this software
+// and associated documentation files (the "Software"), to deal in the Software without restriction,
+// including without limitation the rights to use, copy, modify, merge, publish, distribute,
+// sublicense, and/or sell copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+// The above copyright notice and this permission notice shall be included in all copies or substantial
+// portions of the Software.
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING BUT NOT
+// LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+// IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY,
+// WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+// SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.